@@ -0,0 +1,173 @@
+// 大文件响应微基准：sendfile发送静态文件
+// 在临时目录中生成测试文件作为网站根目录，http_conn通过socketpair按io_uring模式的接口
+// (append_read/process/get_msg/send_file/complete_write)收发，另一端的线程按Content-Length
+// 读完响应体并校验内容，分别测量3MB和64MB文件的吞吐量，结束后删除临时目录
+#include "../http/http_conn.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+static const long TOTAL = 256L * 1024 * 1024; // 每种文件大小发送的响应体字节数
+
+static double now_s() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 文件内容按偏移生成，读取端据此校验
+static inline char content_at(long pos) { return (char)('a' + pos % 26); }
+
+static bool make_file(const char *path, long size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    static char buf[64 * 1024];
+    for (long pos = 0; pos < size;) {
+        int n = size - pos < (long)sizeof(buf) ? (int)(size - pos) : sizeof(buf);
+        for (int i = 0; i < n; ++i)
+            buf[i] = content_at(pos + i);
+        if (::write(fd, buf, n) != n) {
+            close(fd);
+            return false;
+        }
+        pos += n;
+    }
+    close(fd);
+    return true;
+}
+
+// 读取端：依次读取rounds个响应，返回响应体总字节数，状态行、长度或内容错误时返回-1
+struct body_reader {
+    int fd;
+    char buf[64 * 1024];
+    int start, end;
+
+    bool fill() {
+        if (start > 0) {
+            memmove(buf, buf + start, end - start);
+            end -= start;
+            start = 0;
+        }
+        int n = recv(fd, buf + end, sizeof(buf) - end, 0);
+        if (n <= 0)
+            return false;
+        end += n;
+        return true;
+    }
+
+    // 读到空行为止，返回Content-Length，不是200时返回-1
+    long header() {
+        char *p;
+        while ((p = (char *)memmem(buf + start, end - start, "\r\n\r\n", 4)) ==
+               NULL) {
+            if (!fill())
+                return -1;
+        }
+        *p = '\0';
+        char *h = buf + start;
+        start = p + 4 - buf;
+        if (strncmp(h, "HTTP/1.1 200", 12) != 0)
+            return -1;
+        char *cl = strstr(h, "Content-Length:");
+        return cl ? atol(cl + 15) : -1;
+    }
+
+    long run(int rounds, long size) {
+        start = end = 0;
+        long body = 0;
+        for (int r = 0; r < rounds; ++r) {
+            if (header() != size)
+                return -1;
+            for (long pos = 0; pos < size;) {
+                if (start == end && !fill())
+                    return -1;
+                int n = end - start < size - pos ? end - start : (int)(size - pos);
+                for (int i = 0; i < n; ++i) {
+                    if (buf[start + i] != content_at(pos + i))
+                        return -1;
+                }
+                start += n;
+                pos += n;
+            }
+            body += size;
+        }
+        return body;
+    }
+};
+
+int main() {
+    char root[] = "/tmp/file_bench.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[sizeof(root) + 16];
+    snprintf(path, sizeof(path), "%s/big.bin", root);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        rmdir(root);
+        return 1;
+    }
+    completion_queue cq;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    http_conn *conn = new http_conn;
+    conn->init(fds[0], 1, addr, -1, &cq, root, 0, 1, "", "", "", 0);
+
+    static const char req[] =
+        "GET /big.bin HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    const long sizes[] = {3L * 1000 * 1000, 64L * 1024 * 1024};
+    int ret = 0;
+    printf("%-10s %10s %12s %10s\n", "size", "rounds", "MB/s", "ok");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        long size = sizes[s];
+        if (!make_file(path, size)) {
+            perror(path);
+            ret = 1;
+            break;
+        }
+        int rounds = (int)(TOTAL / size);
+        body_reader *reader = new body_reader;
+        reader->fd = fds[1];
+        long body = -1;
+        std::thread t([&] { body = reader->run(rounds, size); });
+
+        double t0 = now_s();
+        for (int r = 0; r < rounds; ++r) {
+            conn->append_read(req, sizeof(req) - 1);
+            conn->process();
+            bool pending = true;
+            while (pending) {
+                int flags = 0;
+                struct msghdr *msg = conn->get_msg(flags);
+                int n = msg ? sendmsg(fds[0], msg, flags) : conn->send_file();
+                if (n < 0 || !conn->complete_write(n, pending))
+                    break;
+            }
+        }
+        t.join();
+        double sec = now_s() - t0;
+
+        char name[24];
+        snprintf(name, sizeof(name), "%ldKB", size / 1024);
+        printf("%-10s %10d %12.1f %10s\n", name, rounds,
+               (double)rounds * size / sec / (1024 * 1024),
+               body == (long)rounds * size ? "yes" : "no");
+        delete reader;
+    }
+    delete conn;
+    close(fds[0]);
+    close(fds[1]);
+    unlink(path);
+    rmdir(root);
+    return ret;
+}
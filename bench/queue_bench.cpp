@@ -0,0 +1,133 @@
+// 请求队列竞争微基准：mpmc_ring 对比原先互斥锁加条件变量的队列
+// locked_list 即原threadpool的std::list请求队列，locked_queue 即原block_queue；
+// P个生产者和P个消费者同时阻塞式入队/出队，测量每个元素的平均耗时和总吞吐
+#include "../threadpool/mpmc_ring.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+static const long ITEMS = 1000000; // 每轮传递的元素总数
+static const int RING_SIZE = 1024;
+
+static double now_ns() {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 原threadpool的请求队列：每次入队分配一个链表节点
+class locked_list {
+  public:
+    void push(long item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_list.push_back(item);
+        m_cond.notify_one();
+    }
+    bool pop(long &item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return !m_list.empty(); });
+        item = m_list.front();
+        m_list.pop_front();
+        return true;
+    }
+
+  private:
+    std::list<long> m_list;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+// 原block_queue：std::queue(deque)加互斥锁
+class locked_queue {
+  public:
+    void push(long item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queue.push(item);
+        m_cond.notify_one();
+    }
+    bool pop(long &item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return !m_queue.empty(); });
+        item = m_queue.front();
+        m_queue.pop();
+        return true;
+    }
+
+  private:
+    std::queue<long> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+class ring_queue {
+  public:
+    ring_queue() : m_ring(RING_SIZE) {}
+    void push(long item) { m_ring.push(item); }
+    bool pop(long &item) { return m_ring.pop(item); }
+
+  private:
+    mpmc_ring<long> m_ring;
+};
+
+// 生产者发完后每个消费者收到一个-1结束，返回每个元素的平均耗时(ns)
+template <typename Queue> static double run(int threads) {
+    Queue q;
+    std::vector<std::thread> producers, consumers;
+    std::vector<long> sums(threads, 0);
+    long per = ITEMS / threads;
+
+    double t0 = now_ns();
+    for (int i = 0; i < threads; ++i) {
+        consumers.push_back(std::thread([&q, &sums, i]() {
+            long item, sum = 0;
+            while (q.pop(item) && item >= 0)
+                sum += item;
+            sums[i] = sum;
+        }));
+    }
+    for (int i = 0; i < threads; ++i) {
+        producers.push_back(std::thread([&q, per]() {
+            for (long j = 0; j < per; ++j)
+                q.push(j);
+        }));
+    }
+    for (size_t i = 0; i < producers.size(); ++i)
+        producers[i].join();
+    for (int i = 0; i < threads; ++i)
+        q.push(-1);
+    for (size_t i = 0; i < consumers.size(); ++i)
+        consumers[i].join();
+    double elapsed = now_ns() - t0;
+
+    long total = 0;
+    for (int i = 0; i < threads; ++i)
+        total += sums[i];
+    if (total != threads * (per * (per - 1) / 2))
+        printf("lost items\n");
+    return elapsed / (per * threads);
+}
+
+int main() {
+    const int threads[] = {1, 4, 16};
+    printf("%-14s %8s %12s %14s\n", "queue", "P x C", "ns/item",
+           "Mitems/s");
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        int n = threads[i];
+        double l = run<locked_list>(n);
+        printf("%-14s %4dx%-3d %12.1f %14.2f\n", "locked_list", n, n, l,
+               1000.0 / l);
+        double q = run<locked_queue>(n);
+        printf("%-14s %4dx%-3d %12.1f %14.2f\n", "locked_queue", n, n, q,
+               1000.0 / q);
+        double r = run<ring_queue>(n);
+        printf("%-14s %4dx%-3d %12.1f %14.2f\n", "mpmc_ring", n, n, r,
+               1000.0 / r);
+    }
+    return 0;
+}
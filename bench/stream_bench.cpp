@@ -0,0 +1,159 @@
+// 流式响应微基准：分块编码的生成和发送
+// 注册一个流式路由，http_conn通过socketpair按io_uring模式的接口(append_read/process/
+// get_msg/complete_write)收发，另一端的线程解析分块编码并校验内容，
+// 分别测量生成函数每次写入512B、4KB和整块缓冲区时的吞吐量
+#include "../http/http_conn.h"
+#include "../http/router.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+
+static const long TOTAL = 256L * 1024 * 1024; // 每种块大小发送的响应体字节数
+
+static int g_block; // 生成函数每次写入的字节数，0表示写满cap
+
+static double now_s() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 按偏移生成可校验的内容，cursor.pos为已生成的字节数
+static int bench_stream(stream_cursor &cursor, char *out, int cap) {
+    long left = TOTAL - cursor.pos;
+    int n = g_block && g_block < cap ? g_block : cap;
+    if (left < n)
+        n = (int)left;
+    for (int i = 0; i < n; ++i)
+        out[i] = (char)('a' + (cursor.pos + i) % 26);
+    cursor.pos += n;
+    return n;
+}
+
+// 读取端：跳过响应头，逐块解析到结束块为止，返回响应体字节数，格式或内容错误时返回-1
+struct chunk_reader {
+    int fd;
+    char buf[64 * 1024];
+    int start, end;
+    long chunks;
+
+    bool fill() {
+        if (start > 0) {
+            memmove(buf, buf + start, end - start);
+            end -= start;
+            start = 0;
+        }
+        int n = recv(fd, buf + end, sizeof(buf) - end, 0);
+        if (n <= 0)
+            return false;
+        end += n;
+        return true;
+    }
+
+    // 取到"\r\n"结尾的一行，返回行首，start移到下一行
+    char *line() {
+        while (true) {
+            char *p = (char *)memmem(buf + start, end - start, "\r\n", 2);
+            if (p) {
+                char *l = buf + start;
+                *p = '\0';
+                start = p + 2 - buf;
+                return l;
+            }
+            if (!fill())
+                return NULL;
+        }
+    }
+
+    long run() {
+        start = end = 0;
+        chunks = 0;
+        char *l;
+        while ((l = line()) != NULL && *l)
+            ;
+        if (!l)
+            return -1;
+        long body = 0;
+        while ((l = line()) != NULL) {
+            long size = strtol(l, NULL, 16);
+            if (size == 0)
+                return line() ? body : -1;
+            while (size > 0) {
+                if (start == end && !fill())
+                    return -1;
+                int n = end - start < size ? end - start : (int)size;
+                for (int i = 0; i < n; ++i) {
+                    if (buf[start + i] != (char)('a' + (body + i) % 26))
+                        return -1;
+                }
+                start += n;
+                body += n;
+                size -= n;
+            }
+            if (!(l = line()) || *l)
+                return -1;
+            ++chunks;
+        }
+        return -1;
+    }
+};
+
+int main() {
+    router::get_instance()->add_stream(http_conn::GET, "/stream",
+                                       bench_stream);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    completion_queue cq;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    char root[] = ".";
+    http_conn *conn = new http_conn;
+    conn->init(fds[0], 1, addr, -1, &cq, root, 0, 1, "", "", "", 0);
+
+    static const char req[] =
+        "GET /stream HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    const int blocks[] = {512, 4096, 0};
+    printf("%-10s %10s %12s %10s\n", "block", "chunks", "MB/s", "ok");
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); ++b) {
+        g_block = blocks[b];
+        chunk_reader *reader = new chunk_reader;
+        reader->fd = fds[1];
+        long body = -1;
+        std::thread t([&] { body = reader->run(); });
+
+        double t0 = now_s();
+        conn->append_read(req, sizeof(req) - 1);
+        conn->process();
+        bool pending = true;
+        while (pending) {
+            int flags = 0;
+            struct msghdr *msg = conn->get_msg(flags);
+            int n = msg ? sendmsg(fds[0], msg, flags) : conn->send_file();
+            if (n < 0 || !conn->complete_write(n, pending))
+                break;
+        }
+        t.join();
+        double sec = now_s() - t0;
+
+        char name[16];
+        if (g_block)
+            snprintf(name, sizeof(name), "%d", g_block);
+        else
+            snprintf(name, sizeof(name), "full");
+        printf("%-10s %10ld %12.1f %10s\n", name, reader->chunks,
+               TOTAL / sec / (1024 * 1024), body == TOTAL ? "yes" : "no");
+        delete reader;
+    }
+    delete conn;
+    close(fds[0]);
+    close(fds[1]);
+    return 0;
+}
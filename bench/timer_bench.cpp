@@ -0,0 +1,242 @@
+// 定时器容器微基准：sort_timer_lst 对比 time_wheel
+// 模拟服务器的使用方式：每次读写都把连接的超时时间推后(adjust_timer)，
+// 分别在1k/10k/100k个活跃定时器下测量添加、调整、删除和到期处理的单次耗时
+#include "../timer/lst_timer.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static const int OPS = 2000; // 每项测量的操作次数
+
+// 原服务器使用的升序双向链表定时器，添加和调整为O(n)，仅作对比
+class sort_timer_lst {
+  public:
+    sort_timer_lst();
+    ~sort_timer_lst();
+
+    void add_timer(util_timer *timer);
+    void adjust_timer(util_timer *timer);
+    void del_timer(util_timer *timer);
+    void tick();
+
+  private:
+    void add_timer(util_timer *timer, util_timer *lst_head);
+
+    util_timer *head;
+    util_timer *tail;
+};
+
+sort_timer_lst::sort_timer_lst() {
+    head = NULL;
+    tail = NULL;
+}
+sort_timer_lst::~sort_timer_lst() {
+    util_timer *tmp = head;
+    while (tmp) {
+        head = tmp->next;
+        delete tmp;
+        tmp = head;
+    }
+}
+
+void sort_timer_lst::add_timer(util_timer *timer) {
+    if (!timer) {
+        return;
+    }
+    if (!head) {
+        head = tail = timer;
+        return;
+    }
+    if (timer->expire < head->expire) {
+        timer->next = head;
+        head->prev = timer;
+        head = timer;
+        return;
+    }
+    add_timer(timer, head);
+}
+void sort_timer_lst::adjust_timer(util_timer *timer) {
+    if (!timer) {
+        return;
+    }
+    util_timer *tmp = timer->next;
+    if (!tmp || (timer->expire < tmp->expire)) {
+        return;
+    }
+    if (timer == head) {
+        head = head->next;
+        head->prev = NULL;
+        timer->next = NULL;
+        add_timer(timer, head);
+    } else {
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        add_timer(timer, timer->next);
+    }
+}
+void sort_timer_lst::del_timer(util_timer *timer) {
+    if (!timer) {
+        return;
+    }
+    if ((timer == head) && (timer == tail)) {
+        delete timer;
+        head = NULL;
+        tail = NULL;
+        return;
+    }
+    if (timer == head) {
+        head = head->next;
+        head->prev = NULL;
+        delete timer;
+        return;
+    }
+    if (timer == tail) {
+        tail = tail->prev;
+        tail->next = NULL;
+        delete timer;
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    delete timer;
+}
+void sort_timer_lst::tick() {
+    if (!head) {
+        return;
+    }
+
+    time_t cur = monotonic_ms();
+    util_timer *tmp = head;
+    while (tmp) {
+        if (cur < tmp->expire) {
+            break;
+        }
+        tmp->cb_func(tmp->user_data);
+        head = tmp->next;
+        if (head) {
+            head->prev = NULL;
+        }
+        delete tmp;
+        tmp = head;
+    }
+}
+
+void sort_timer_lst::add_timer(util_timer *timer, util_timer *lst_head) {
+    util_timer *prev = lst_head;
+    util_timer *tmp = prev->next;
+    while (tmp) {
+        if (timer->expire < tmp->expire) {
+            prev->next = timer;
+            timer->next = tmp;
+            tmp->prev = timer;
+            timer->prev = prev;
+            break;
+        }
+        prev = tmp;
+        tmp = tmp->next;
+    }
+    if (!tmp) {
+        prev->next = timer;
+        timer->prev = prev;
+        timer->next = NULL;
+        tail = timer;
+    }
+}
+
+static void noop_cb(client_data *) {}
+
+static double now_ns() {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct result {
+    double add, adjust, del, expire;
+};
+
+// 初始定时器按到期时间从晚到早加入，链表每次都插在头部，建表本身不计时
+template <typename Container>
+static void fill(Container &c, std::vector<util_timer *> &timers, int n,
+                 time_t base) {
+    for (int i = 0; i < n; ++i) {
+        util_timer *t = new util_timer;
+        t->expire = base + (n - i);
+        t->cb_func = noop_cb;
+        t->user_data = NULL;
+        c.add_timer(t);
+        timers[n - 1 - i] = t;
+    }
+}
+
+template <typename Container> static result run(int n) {
+    result r;
+    time_t base = time(NULL) + 10;
+    std::vector<util_timer *> timers(n);
+    srand(1);
+
+    {
+        Container c;
+        fill(c, timers, n, base);
+
+        // 新连接：到期时间晚于所有已有定时器
+        double t0 = now_ns();
+        std::vector<util_timer *> extra(OPS);
+        for (int i = 0; i < OPS; ++i) {
+            extra[i] = new util_timer;
+            extra[i]->expire = base + n + i;
+            extra[i]->cb_func = noop_cb;
+            extra[i]->user_data = NULL;
+            c.add_timer(extra[i]);
+        }
+        r.add = (now_ns() - t0) / OPS;
+
+        // 活跃连接：到期时间推后到最晚
+        t0 = now_ns();
+        for (int i = 0; i < OPS; ++i) {
+            util_timer *t = timers[rand() % n];
+            t->expire = base + n + OPS + i;
+            c.adjust_timer(t);
+        }
+        r.adjust = (now_ns() - t0) / OPS;
+
+        t0 = now_ns();
+        for (int i = 0; i < OPS; ++i) {
+            c.del_timer(extra[i]);
+        }
+        r.del = (now_ns() - t0) / OPS;
+    }
+
+    // 到期处理：全部定时器已超时，一次tick全部处理
+    {
+        Container c;
+        for (int i = 0; i < n; ++i) {
+            util_timer *t = new util_timer;
+            t->expire = base - 20 - i;
+            t->cb_func = noop_cb;
+            t->user_data = NULL;
+            c.add_timer(t);
+        }
+        double t0 = now_ns();
+        c.tick();
+        r.expire = (now_ns() - t0) / n;
+    }
+    return r;
+}
+
+int main() {
+    const int sizes[] = {1000, 10000, 100000};
+    printf("%-16s %8s %12s %12s %12s %12s\n", "container", "timers",
+           "add(ns)", "adjust(ns)", "del(ns)", "expire(ns)");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        result l = run<sort_timer_lst>(sizes[i]);
+        printf("%-16s %8d %12.1f %12.1f %12.1f %12.1f\n", "sort_timer_lst",
+               sizes[i], l.add, l.adjust, l.del, l.expire);
+        result w = run<time_wheel>(sizes[i]);
+        printf("%-16s %8d %12.1f %12.1f %12.1f %12.1f\n", "time_wheel",
+               sizes[i], w.add, w.adjust, w.del, w.expire);
+    }
+    return 0;
+}
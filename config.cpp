@@ -25,16 +25,58 @@ Config::Config() {
     // 线程池内的线程数量,默认8
     thread_num = 8;
 
+    // sub reactor数量,默认0,即单reactor
+    loop_num = 0;
+
     // 关闭日志,默认不关闭
     close_log = 0;
 
     // 并发模型,默认是proactor
     actor_model = 0;
+
+    // I/O后端,默认epoll,1为io_uring(内核不支持时回退到epoll)
+    uring_mode = 0;
+
+    // 请求处理中的空闲超时,默认15000毫秒
+    idle_timeout = 15000;
+
+    // 请求头接收超时,默认15000毫秒
+    header_timeout = 15000;
+
+    // keep-alive等待下一个请求的超时,默认15000毫秒
+    keepalive_timeout = 15000;
+
+    // 请求体长度上限,默认1MB,超过返回413
+    max_body = 1024 * 1024;
+
+    // 全连接队列长度,默认1024,实际还受net.core.somaxconn限制
+    backlog = 1024;
+
+    // 静态文件缓存,默认64MB,只缓存不超过1MB的文件,大小为0时关闭
+    cache_size = 64;
+    cache_object = 1024;
+
+    // 打开文件缓存,默认256项,每秒最多重新stat一次,项数为0时关闭
+    fd_cache = 256;
+    fd_cache_valid = 1000;
+
+    // gzip压缩,默认只压缩不小于1KB的文本文件,为0时关闭
+    gzip_min = 1024;
+
+    // CPU绑定,默认不绑定;启用后按NUMA节点分组,CPU列表为空表示全部可用CPU
+    affinity = 0;
+
+    // 线程数自适应的范围,默认都取thread_num,即线程数固定
+    min_threads = 0;
+    max_threads = 0;
+
+    // 数据库通道的线程数,默认与数据库连接池数量相同,线程不会多于可用的连接
+    db_threads = 0;
 }
 
 void Config::parse_arg(int argc, char *argv[]) {
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:r:c:a:u:i:H:k:b:q:M:O:F:V:z:A:C:W:n:x:d:";
     while ((opt = getopt(argc, argv, str)) != -1) {
         switch (opt) {
         case 'p': {
@@ -61,6 +103,10 @@ void Config::parse_arg(int argc, char *argv[]) {
             thread_num = atoi(optarg);
             break;
         }
+        case 'r': {
+            loop_num = atoi(optarg);
+            break;
+        }
         case 'c': {
             close_log = atoi(optarg);
             break;
@@ -69,6 +115,74 @@ void Config::parse_arg(int argc, char *argv[]) {
             actor_model = atoi(optarg);
             break;
         }
+        case 'u': {
+            uring_mode = atoi(optarg);
+            break;
+        }
+        case 'i': {
+            idle_timeout = atoi(optarg);
+            break;
+        }
+        case 'H': {
+            header_timeout = atoi(optarg);
+            break;
+        }
+        case 'k': {
+            keepalive_timeout = atoi(optarg);
+            break;
+        }
+        case 'b': {
+            max_body = atoi(optarg);
+            break;
+        }
+        case 'q': {
+            backlog = atoi(optarg);
+            break;
+        }
+        case 'M': {
+            cache_size = atoi(optarg);
+            break;
+        }
+        case 'O': {
+            cache_object = atoi(optarg);
+            break;
+        }
+        case 'F': {
+            fd_cache = atoi(optarg);
+            break;
+        }
+        case 'V': {
+            fd_cache_valid = atoi(optarg);
+            break;
+        }
+        case 'z': {
+            gzip_min = atoi(optarg);
+            break;
+        }
+        case 'A': {
+            affinity = atoi(optarg);
+            break;
+        }
+        case 'C': {
+            loop_cpus = optarg;
+            break;
+        }
+        case 'W': {
+            worker_cpus = optarg;
+            break;
+        }
+        case 'n': {
+            min_threads = atoi(optarg);
+            break;
+        }
+        case 'x': {
+            max_threads = atoi(optarg);
+            break;
+        }
+        case 'd': {
+            db_threads = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
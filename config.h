@@ -34,11 +34,51 @@ class Config {
     // 线程池内的线程数量
     int thread_num;
 
+    // sub reactor数量，0为单reactor
+    int loop_num;
+
     // 是否关闭日志
     int close_log;
 
     // 并发模型选择
     int actor_model;
+
+    // I/O后端选择
+    int uring_mode;
+
+    // 超时，单位毫秒
+    int idle_timeout;
+    int header_timeout;
+    int keepalive_timeout;
+
+    // 请求体长度上限，单位字节
+    int max_body;
+
+    // listen的全连接队列长度
+    int backlog;
+
+    // 静态文件缓存大小(MB)和可缓存的最大文件(KB)
+    int cache_size;
+    int cache_object;
+
+    // 大文件的打开文件缓存项数和重新验证间隔(毫秒)
+    int fd_cache;
+    int fd_cache_valid;
+
+    // 启用gzip压缩的最小文件字节数
+    int gzip_min;
+
+    // 是否绑定CPU，以及事件循环、工作线程可用的CPU列表
+    int affinity;
+    std::string loop_cpus;
+    std::string worker_cpus;
+
+    // 线程池自适应的线程数下限和上限，0表示取thread_num
+    int min_threads;
+    int max_threads;
+
+    // 数据库通道的线程数，0表示与数据库连接池数量相同
+    int db_threads;
 };
 
 #endif
\ No newline at end of file
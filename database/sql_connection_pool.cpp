@@ -8,8 +8,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <time.h>
 
 connection_pool::connection_pool() {
+    m_MaxConn = 0;
     m_CurConn = 0;
     m_FreeConn = 0;
 }
@@ -56,9 +58,11 @@ void connection_pool::init(std::string url, std::string User,
 // 当有请求时，从数据库连接池中返回一个可用连接，更新使用和空闲连接数
 MYSQL *connection_pool::GetConnection() {
 
-    if (0 == connList.size())
+    // 没有建立任何连接时直接返回；连接都在使用中时等待归还
+    if (0 == m_MaxConn)
         return NULL;
 
+    sqlWaitRAII wait;
     std::unique_lock<std::mutex> locker(mtx);
     cond.wait(locker, [this] { return !connList.empty(); });
 
@@ -113,4 +117,22 @@ connectionRAII::connectionRAII(MYSQL **SQL, connection_pool *connPool) {
     poolRAII = connPool;
 }
 
-connectionRAII::~connectionRAII() { poolRAII->ReleaseConnection(conRAII); }
\ No newline at end of file
+connectionRAII::~connectionRAII() { poolRAII->ReleaseConnection(conRAII); }
+// 当前线程累计的阻塞时间
+static thread_local long long sql_wait_ns = 0;
+
+static long long sql_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+sqlWaitRAII::sqlWaitRAII() { m_start = sql_now_ns(); }
+
+sqlWaitRAII::~sqlWaitRAII() { sql_wait_ns += sql_now_ns() - m_start; }
+
+long long sqlWaitRAII::take() {
+    long long ns = sql_wait_ns;
+    sql_wait_ns = 0;
+    return ns;
+}
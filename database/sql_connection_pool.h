@@ -55,4 +55,19 @@ class connectionRAII {
     connection_pool *poolRAII;
 };
 
+// 统计当前线程阻塞在数据库上的时间：等待空闲连接和执行查询时在作用域内计时
+// 线程池据此区分工作线程是在占用CPU还是在空等数据库
+class sqlWaitRAII {
+
+  public:
+    sqlWaitRAII();
+    ~sqlWaitRAII();
+
+    // 取出当前线程累计的阻塞时间(纳秒)并清零
+    static long long take();
+
+  private:
+    long long m_start;
+};
+
 #endif
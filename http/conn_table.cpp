@@ -0,0 +1,71 @@
+#include "conn_table.h"
+
+conn_table::conn_table(int max_fd)
+    : m_max_fd(max_fd), m_gen(1) {
+    for (int i = 0; i < CPU_MAX_NODES; ++i)
+        m_free[i] = NULL;
+    m_page_num = (max_fd + PAGE_SIZE - 1) / PAGE_SIZE;
+    m_pages = new std::atomic<std::atomic<conn_slot *> *>[m_page_num];
+    for (int i = 0; i < m_page_num; ++i)
+        m_pages[i].store(NULL);
+}
+
+conn_table::~conn_table() {
+    for (int i = 0; i < m_page_num; ++i)
+        delete[] m_pages[i].load();
+    delete[] m_pages;
+    for (size_t i = 0; i < m_slabs.size(); ++i)
+        delete[] m_slabs[i];
+}
+
+conn_slot *conn_table::acquire(int fd) {
+    if (fd < 0 || fd >= m_max_fd)
+        return NULL;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::atomic<conn_slot *> *page = m_pages[fd >> PAGE_SHIFT].load();
+    if (!page) {
+        page = new std::atomic<conn_slot *>[PAGE_SIZE];
+        for (int i = 0; i < PAGE_SIZE; ++i)
+            page[i].store(NULL);
+        m_pages[fd >> PAGE_SHIFT].store(page, std::memory_order_release);
+    }
+
+    // 由当前线程构造新的slab，内存按first-touch落在本节点
+    int node = cpu_affinity::current_group() % CPU_MAX_NODES;
+    if (!m_free[node]) {
+        conn_slot *slab = new conn_slot[SLAB_SIZE];
+        for (int i = 0; i < SLAB_SIZE; ++i) {
+            slab[i].node = node;
+            slab[i].next_free = m_free[node];
+            m_free[node] = &slab[i];
+        }
+        m_slabs.push_back(slab);
+    }
+    conn_slot *slot = m_free[node];
+    m_free[node] = slot->next_free;
+    lock.unlock();
+
+    // 代数全表递增，fd和槽被复用后，旧连接遗留的io_uring完成事件都不会匹配
+    slot->next_free = NULL;
+    slot->data.io_gen = m_gen.fetch_add(1);
+    slot->data.timer = NULL;
+    page[fd & (PAGE_SIZE - 1)].store(slot, std::memory_order_release);
+    return slot;
+}
+
+void conn_table::release(int fd) {
+    if (fd < 0 || fd >= m_max_fd)
+        return;
+    std::atomic<conn_slot *> *page = m_pages[fd >> PAGE_SHIFT].load();
+    if (!page)
+        return;
+    conn_slot *slot = page[fd & (PAGE_SIZE - 1)].exchange(NULL);
+    if (!slot)
+        return;
+    slot->conn.release_buffers();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    slot->next_free = m_free[slot->node];
+    m_free[slot->node] = slot;
+}
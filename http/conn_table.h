@@ -0,0 +1,59 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "../threadpool/cpu_affinity.h"
+#include "../timer/lst_timer.h"
+#include "http_conn.h"
+
+// 一个连接占用的槽：http_conn与定时器数据放在一起，建立连接时分配，关闭时归还
+struct conn_slot {
+    http_conn conn;
+    client_data data;
+    conn_slot *next_free;
+    int node; // 所在slab由哪个节点的线程分配，归还到该节点的空闲链表
+};
+
+// 稀疏连接表，按fd查找连接
+// fd->槽的索引按页分配，只有出现过的fd所在的页才占用内存；
+// 槽从slab批量分配，关闭后放回空闲链表复用，内存随同时在线的连接数增长而不是MAX_FD；
+// 空闲链表按NUMA节点分开，接管连接的事件循环只复用本节点线程分配的槽
+class conn_table {
+  public:
+    explicit conn_table(int max_fd);
+    ~conn_table();
+
+    // 为新连接分配槽并分配新的连接代数，fd超出范围时返回NULL
+    conn_slot *acquire(int fd);
+    // 连接关闭后归还槽
+    void release(int fd);
+
+    // 事件循环按fd查找，未建立连接的fd返回NULL，不加锁
+    conn_slot *get(int fd) const {
+        if (fd < 0 || fd >= m_max_fd)
+            return NULL;
+        std::atomic<conn_slot *> *page =
+            m_pages[fd >> PAGE_SHIFT].load(std::memory_order_acquire);
+        if (!page)
+            return NULL;
+        return page[fd & (PAGE_SIZE - 1)].load(std::memory_order_acquire);
+    }
+
+  private:
+    static const int PAGE_SHIFT = 10;
+    static const int PAGE_SIZE = 1 << PAGE_SHIFT; // 每页索引1024个fd
+    static const int SLAB_SIZE = 32;              // 每次分配32个槽
+
+    int m_max_fd;
+    int m_page_num;
+    std::atomic<std::atomic<conn_slot *> *> *m_pages;
+    std::mutex m_mutex; // 保护页分配和空闲链表
+    conn_slot *m_free[CPU_MAX_NODES];
+    std::vector<conn_slot *> m_slabs;
+    std::atomic<unsigned int> m_gen;
+};
+
+#endif
@@ -0,0 +1,331 @@
+#include "file_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../log/log.h"
+#include "http_header.h"
+#include "http_validator.h"
+
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+                                   IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                   IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+// gzip表示的缓存键后缀，请求行以空白分隔，路径中不会出现'\t'
+static const char GZIP_KEY[] = "\tgzip";
+
+// 值得压缩的文本文件扩展名
+static const char *const GZIP_TYPES[] = {".html", ".htm", ".css", ".js",
+                                         ".txt",  ".xml", ".json", ".svg"};
+
+file_cache::file_cache()
+    : m_capacity(0), m_max_object(0), m_gzip_min(0), m_close_log(1),
+      m_bytes(0), m_inotify_fd(-1), m_gen(0), m_hits(0), m_misses(0),
+      m_hit_bytes(0), m_gzip_hits(0), m_compressed(0), m_evictions(0),
+      m_invalidations(0) {}
+
+file_cache::~file_cache() {
+    if (m_inotify_fd != -1)
+        close(m_inotify_fd);
+}
+
+bool file_cache::init(const char *root, long capacity, long max_object,
+                      long gzip_min, int close_log) {
+    m_close_log = close_log;
+    m_max_object = max_object;
+    m_gzip_min = gzip_min;
+    if (capacity <= 0)
+        return true;
+
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd == -1) {
+        LOG_WARN("inotify_init1 failed, errno is:%d, file cache disabled",
+                 errno);
+        return false;
+    }
+    add_watch(root);
+    if (m_watches.empty()) {
+        LOG_WARN("cannot watch %s, file cache disabled", root);
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+        return false;
+    }
+    m_capacity = capacity;
+    return true;
+}
+
+// 监视目录及其子目录，新建的子目录在收到事件时再加入
+void file_cache::add_watch(const std::string &dir) {
+    int wd = inotify_add_watch(m_inotify_fd, dir.c_str(), WATCH_MASK);
+    if (wd == -1) {
+        LOG_WARN("inotify_add_watch %s failed, errno is:%d", dir.c_str(),
+                 errno);
+        return;
+    }
+    m_watches[wd] = dir;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent *ent = readdir(d)) {
+        if (ent->d_type == DT_DIR && ent->d_name[0] != '.')
+            add_watch(dir + "/" + ent->d_name);
+    }
+    closedir(d);
+}
+
+bool file_cache::compressible(const char *path) const {
+    if (m_gzip_min <= 0)
+        return false;
+    const char *ext = strrchr(path, '.');
+    if (!ext || strchr(ext, '/'))
+        return false;
+    for (const char *type : GZIP_TYPES) {
+        if (strcasecmp(ext, type) == 0)
+            return true;
+    }
+    return false;
+}
+
+std::shared_ptr<const cache_entry> file_cache::lookup(const char *path,
+                                                      bool gzip) {
+    if (!enabled())
+        return std::shared_ptr<const cache_entry>();
+
+    std::string key(path);
+    gzip = gzip && compressible(path);
+    std::shared_ptr<const cache_entry> entry;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = gzip ? m_index.find(key + GZIP_KEY) : m_index.end();
+        // 未压缩的表示只在文件不需要压缩时才能直接返回
+        if (it == m_index.end()) {
+            it = m_index.find(key);
+            if (it != m_index.end() && gzip && (*it->second)->vary)
+                it = m_index.end();
+        }
+        if (it != m_index.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            entry = *it->second;
+        }
+    }
+    if (entry) {
+        ++m_hits;
+        m_hit_bytes += entry->body_len;
+        if (entry->gzip)
+            ++m_gzip_hits;
+    } else {
+        ++m_misses;
+    }
+    return entry;
+}
+
+// 读入fd的全部内容，读取期间文件被截断时返回false
+static bool read_file(int fd, long size, std::string &buf) {
+    buf.resize(size);
+    long done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, &buf[done], size - done, done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+// 以gzip格式压缩，只在缓存时压缩一次，使用最高压缩级别
+static bool gzip_compress(const std::string &in, std::string &out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits加16生成gzip头和尾，而不是zlib格式
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+std::shared_ptr<const cache_entry> file_cache::load(const char *path, int fd,
+                                                    const struct stat &st,
+                                                    unsigned int gen,
+                                                    int flags) {
+    long size = st.st_size;
+    // "//"、"/./"等写法与inotify事件中的路径对不上，无法失效，不缓存
+    if (!cacheable(size) || strstr(path, "//") || strstr(path, "/."))
+        return std::shared_ptr<const cache_entry>();
+
+    std::string body;
+    if (!read_file(fd, size, body))
+        return std::shared_ptr<const cache_entry>();
+    if (flags & CACHE_COMPRESS) {
+        std::string gz;
+        if (!gzip_compress(body, gz))
+            return std::shared_ptr<const cache_entry>();
+        body.swap(gz);
+        ++m_compressed;
+    }
+    size = body.size();
+
+    // 响应头与http_conn::add_file_response生成的200响应一致，各行由同一组函数写入
+    char etag[ETAG_LEN], last_modified[HTTP_DATE_LEN];
+    make_etag(st.st_mtime, st.st_size, etag, flags & CACHE_COMPRESS);
+    http_date(st.st_mtime, last_modified);
+    const http_text &status = status_line(200);
+    char lines[CONTENT_LENGTH_MAX + FILE_HEADERS_MAX];
+    int lines_len = fmt_content_length(lines, size);
+    lines_len += fmt_file_headers(lines + lines_len, etag, last_modified,
+                                  flags & CACHE_GZIP, flags & CACHE_VARY);
+
+    std::shared_ptr<cache_entry> entry = std::make_shared<cache_entry>();
+    entry->path = path;
+    if (flags & CACHE_GZIP)
+        entry->path += GZIP_KEY;
+    entry->close_head.assign(status.data, status.len);
+    entry->close_head.append(lines, lines_len);
+    entry->close_head.append(CONNECTION_CLOSE.data, CONNECTION_CLOSE.len);
+    entry->close_head.append("\r\n", 2);
+    int head_len = status.len + lines_len + CONNECTION_KEEP_ALIVE.len + 2;
+    entry->data.reserve(head_len + size);
+    entry->data.assign(status.data, status.len);
+    entry->data.append(lines, lines_len);
+    entry->data.append(CONNECTION_KEEP_ALIVE.data, CONNECTION_KEEP_ALIVE.len);
+    entry->data.append("\r\n", 2);
+    entry->data.append(body);
+    entry->head_len = head_len;
+    entry->body_len = size;
+    entry->mtime = st.st_mtime;
+    entry->etag = etag;
+    entry->gzip = flags & CACHE_GZIP;
+    entry->vary = flags & CACHE_VARY;
+
+    long charge = entry->data.size() + entry->close_head.size() +
+                  entry->path.size();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // 读取期间有文件变化，读到的内容只用于本次响应
+    if (gen != m_gen.load() || m_index.count(entry->path))
+        return entry;
+    m_lru.push_front(entry);
+    m_index[entry->path] = m_lru.begin();
+    m_bytes += charge;
+    while (m_bytes > m_capacity && m_lru.size() > 1)
+        evict();
+    return entry;
+}
+
+// 淘汰最久未使用的缓存项，调用时需持有m_mutex
+// 正在发送的连接仍持有shared_ptr，内存在发送完毕后才释放
+void file_cache::evict() {
+    const std::shared_ptr<const cache_entry> &entry = m_lru.back();
+    m_bytes -= entry->data.size() + entry->close_head.size() +
+               entry->path.size();
+    m_index.erase(entry->path);
+    m_lru.pop_back();
+    ++m_evictions;
+}
+
+// 文件或其预压缩的.gz文件变化时，两种表示都失效
+void file_cache::invalidate(const std::string &path) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    erase(path);
+    erase(path + GZIP_KEY);
+    size_t len = path.size();
+    if (len > 3 && path.compare(len - 3, 3, ".gz") == 0)
+        erase(path.substr(0, len - 3) + GZIP_KEY);
+}
+
+// 调用时需持有m_mutex
+void file_cache::erase(const std::string &key) {
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+        return;
+    const std::shared_ptr<const cache_entry> &entry = *it->second;
+    m_bytes -= entry->data.size() + entry->close_head.size() +
+               entry->path.size();
+    m_lru.erase(it->second);
+    m_index.erase(it);
+    ++m_invalidations;
+}
+
+void file_cache::clear() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_invalidations += m_index.size();
+    m_index.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
+
+void file_cache::handle_events() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        for (char *p = buf; p < buf + len;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            ++m_gen;
+
+            // 事件队列溢出、目录本身被删除或改名时无法确定受影响的文件，全部清空
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                clear();
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                m_watches.erase(ev->wd);
+                continue;
+            }
+            auto it = m_watches.find(ev->wd);
+            if (it == m_watches.end() || ev->len == 0)
+                continue;
+            std::string path = it->second + "/" + ev->name;
+            if (ev->mask & IN_ISDIR) {
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+                    add_watch(path);
+                else if (ev->mask & IN_MOVED_FROM)
+                    clear();
+                continue;
+            }
+            invalidate(path);
+        }
+    }
+}
+
+void file_cache::get_stats(stats &s) {
+    s.hits = m_hits.load();
+    s.misses = m_misses.load();
+    s.hit_bytes = m_hit_bytes.load();
+    s.gzip_hits = m_gzip_hits.load();
+    s.compressed = m_compressed.load();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    s.entries = m_index.size();
+    s.bytes = m_bytes;
+    s.evictions = m_evictions;
+    s.invalidations = m_invalidations;
+}
+
+void file_cache::log_stats() {
+    if (!enabled())
+        return;
+    stats s;
+    get_stats(s);
+    LOG_INFO("file cache: hits %ld (gzip %ld), misses %ld, hit bytes %ld, "
+             "entries %ld, bytes %ld/%ld, evictions %ld, invalidations %ld, "
+             "compressed %ld",
+             s.hits, s.gzip_hits, s.misses, s.hit_bytes, s.entries, s.bytes,
+             m_capacity, s.evictions, s.invalidations, s.compressed);
+}
@@ -0,0 +1,131 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <time.h>
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 静态文件缓存项，创建后不再修改，可被多个连接同时发送
+// data为keep-alive的响应头加文件内容，连续存放，命中时一个iovec即可发出
+struct cache_entry {
+    std::string path;
+    std::string data;
+    int head_len;
+    std::string close_head; // Connection:close的响应头
+    long body_len;
+    time_t mtime;           // 用于条件请求
+    std::string etag;
+    bool gzip;              // 内容为gzip压缩后的表示
+    bool vary;              // 同一文件有压缩和未压缩两种表示
+
+    const char *body() const { return data.data() + head_len; }
+};
+
+// 按文件路径索引、总大小受限的LRU缓存
+// 文件内容和完整的响应头在第一次请求时生成，之后命中时不再stat/open文件；
+// 通过inotify监视doc_root，文件被修改、删除或改名时使对应的缓存项失效
+// 可压缩的文本文件另有一个gzip表示，来自同目录下预压缩的.gz文件或第一次请求时压缩，
+// 与未压缩的表示分别缓存，客户端接受gzip时优先返回
+class file_cache {
+  public:
+    static file_cache *get_instance() {
+        static file_cache instance;
+        return &instance;
+    }
+
+    struct stats {
+        long hits;
+        long misses;
+        long hit_bytes; // 命中时发送的文件字节数
+        long gzip_hits; // 命中gzip表示的次数
+        long compressed;
+        long entries;
+        long bytes;     // 缓存占用的字节数
+        long evictions;
+        long invalidations;
+    };
+
+    // load的选项
+    enum
+    {
+        CACHE_VARY = 1,    // 响应带Vary:Accept-Encoding
+        CACHE_GZIP = 2,    // 作为path的gzip表示缓存，响应带Content-Encoding:gzip
+        CACHE_COMPRESS = 4 // 读入的内容需要先压缩，否则fd已是预压缩的文件
+    };
+
+    // capacity为缓存总大小，max_object为可缓存的最大文件，capacity为0时关闭缓存
+    // gzip_min为压缩的最小文件，0时不压缩；缓存关闭时仍可发送预压缩的.gz文件
+    // 无法监视root时关闭缓存并返回false
+    bool init(const char *root, long capacity, long max_object, long gzip_min,
+              int close_log);
+    bool enabled() const { return m_capacity > 0; }
+    bool cacheable(long size) const {
+        return enabled() && size > 0 && size <= m_max_object;
+    }
+    // 按扩展名判断是否为值得压缩的文本文件，图片、视频等已压缩的格式不再压缩
+    bool compressible(const char *path) const;
+    bool compressible(const char *path, long size) const {
+        return size >= m_gzip_min && compressible(path);
+    }
+
+    // 查找前记下代数，读文件期间有失效事件时不把读到的内容放入缓存
+    unsigned int generation() const { return m_gen.load(); }
+    // gzip为客户端接受gzip，有gzip表示时优先返回
+    std::shared_ptr<const cache_entry> lookup(const char *path, bool gzip);
+    // 从fd读入文件并生成缓存项，失败时返回空
+    std::shared_ptr<const cache_entry> load(const char *path, int fd,
+                                            const struct stat &st,
+                                            unsigned int gen, int flags);
+
+    // inotify事件由主循环在fd可读时处理
+    int get_fd() const { return m_inotify_fd; }
+    void handle_events();
+
+    void get_stats(stats &s);
+    void log_stats();
+
+  private:
+    file_cache();
+    ~file_cache();
+
+    void add_watch(const std::string &dir);
+    void invalidate(const std::string &path);
+    void erase(const std::string &key);
+    void clear();
+    void evict();
+
+  private:
+    typedef std::list<std::shared_ptr<const cache_entry>> lru_list;
+
+    long m_capacity;
+    long m_max_object;
+    long m_gzip_min;
+    int m_close_log;
+
+    std::mutex m_mutex;
+    lru_list m_lru; // 表头为最近使用的缓存项
+    // 键为文件路径，gzip表示的键为路径加GZIP_KEY
+    std::unordered_map<std::string, lru_list::iterator> m_index;
+    long m_bytes;
+
+    int m_inotify_fd;
+    std::map<int, std::string> m_watches; // watch描述符到目录的映射
+    std::atomic<unsigned int> m_gen;
+
+    std::atomic<long> m_hits;
+    std::atomic<long> m_misses;
+    std::atomic<long> m_hit_bytes;
+    std::atomic<long> m_gzip_hits;
+    std::atomic<long> m_compressed; // 压缩生成的gzip表示数
+    long m_evictions;
+    long m_invalidations;
+};
+
+#endif
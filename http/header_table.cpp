@@ -0,0 +1,104 @@
+#include "header_table.h"
+
+#include <string.h>
+
+// 下标与HEADER_ID一一对应
+static const struct {
+    const char *name;
+    int len;
+} HEADER_NAMES[HDR_COUNT] = {
+    {"Accept", 6},
+    {"Accept-Encoding", 15},
+    {"Connection", 10},
+    {"Content-Length", 14},
+    {"Content-Type", 12},
+    {"Cookie", 6},
+    {"Host", 4},
+    {"If-Modified-Since", 17},
+    {"If-None-Match", 13},
+    {"If-Range", 8},
+    {"Range", 5},
+    {"Referer", 7},
+    {"Transfer-Encoding", 17},
+    {"User-Agent", 10},
+};
+
+// 先按长度、再按首字母确定唯一的候选，最后整体比较一次
+HEADER_ID header_id(const http_view &name) {
+    HEADER_ID id;
+    char c = name.len > 0 ? (name.data[0] | 0x20) : 0;
+    switch (name.len) {
+    case 4:
+        id = HDR_HOST;
+        break;
+    case 5:
+        id = HDR_RANGE;
+        break;
+    case 6:
+        id = c == 'a' ? HDR_ACCEPT : HDR_COOKIE;
+        break;
+    case 7:
+        id = HDR_REFERER;
+        break;
+    case 8:
+        id = HDR_IF_RANGE;
+        break;
+    case 10:
+        id = c == 'c' ? HDR_CONNECTION : HDR_USER_AGENT;
+        break;
+    case 12:
+        id = HDR_CONTENT_TYPE;
+        break;
+    case 13:
+        id = HDR_IF_NONE_MATCH;
+        break;
+    case 14:
+        id = HDR_CONTENT_LENGTH;
+        break;
+    case 15:
+        id = HDR_ACCEPT_ENCODING;
+        break;
+    case 17:
+        id = c == 'i' ? HDR_IF_MODIFIED_SINCE : HDR_TRANSFER_ENCODING;
+        break;
+    default:
+        return HDR_OTHER;
+    }
+    return view_equal(name, HEADER_NAMES[id].name, HEADER_NAMES[id].len)
+               ? id
+               : HDR_OTHER;
+}
+
+void header_table::clear() {
+    memset(m_value, 0, sizeof(m_value));
+    m_other_count = 0;
+}
+
+bool header_table::add(HEADER_ID id, char *value) {
+    if (m_value[id])
+        return false;
+    m_value[id] = value;
+    return true;
+}
+
+bool header_table::add_other(const http_view &name, char *value, int len) {
+    if (m_other_count == MAX_OTHER)
+        return false;
+    field &f = m_other[m_other_count++];
+    f.name = name.data;
+    f.name_len = name.len;
+    f.value = value;
+    f.value_len = len;
+    return true;
+}
+
+void header_table::rebase(const char *from, char *to) {
+    for (int i = 0; i < HDR_COUNT; ++i) {
+        if (m_value[i])
+            m_value[i] = to + (m_value[i] - from);
+    }
+    for (int i = 0; i < m_other_count; ++i) {
+        m_other[i].name = to + (m_other[i].name - from);
+        m_other[i].value = to + (m_other[i].value - from);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef HEADER_TABLE_H
+#define HEADER_TABLE_H
+
+#include "http_scan.h"
+
+// 常用的请求头，按名字长度分派查找，下标访问
+enum HEADER_ID
+{
+    HDR_OTHER = -1,
+    HDR_ACCEPT = 0,
+    HDR_ACCEPT_ENCODING,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_COOKIE,
+    HDR_HOST,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_RANGE,
+    HDR_RANGE,
+    HDR_REFERER,
+    HDR_TRANSFER_ENCODING,
+    HDR_USER_AGENT,
+    HDR_COUNT
+};
+
+// 名字忽略大小写，不是常用请求头时返回HDR_OTHER
+HEADER_ID header_id(const http_view &name);
+
+// 一个请求的全部请求头，名字和值都指向读缓冲区，值以'\0'结尾
+// 常用请求头按HEADER_ID存放，其余的依次存放在定长数组中，超过上限时由调用者拒绝请求；
+// 读缓冲区移动或扩容时需要rebase
+class header_table {
+  public:
+    enum { MAX_OTHER = 32 };
+
+    struct field {
+        const char *name;
+        int name_len;
+        char *value;
+        int value_len;
+    };
+
+    header_table() { clear(); }
+    void clear();
+
+    // 同一个常用请求头重复出现时保留第一个并返回false
+    bool add(HEADER_ID id, char *value);
+    // 存放一个不常用的请求头，已满MAX_OTHER个时返回false
+    bool add_other(const http_view &name, char *value, int len);
+
+    // 没有该请求头时返回NULL
+    char *get(HEADER_ID id) const { return m_value[id]; }
+
+    int other_count() const { return m_other_count; }
+    const field &other(int i) const { return m_other[i]; }
+
+    void rebase(const char *from, char *to);
+
+  private:
+    char *m_value[HDR_COUNT];
+    field m_other[MAX_OTHER];
+    int m_other_count;
+};
+
+#endif
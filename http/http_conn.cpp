@@ -4,26 +4,19 @@
 #include <fstream>
 #include <mutex>
 #include <mysql/mysql.h>
+#include <set>
 #include <unistd.h>
 
-// 定义http响应的一些状态信息
-const char *ok_200_title = "OK";
-const char *error_400_title = "Bad Request";
-const char *error_400_form =
-    "Your request has bad syntax or is inherently impossible to staisfy.\n";
-const char *error_403_title = "Forbidden";
-const char *error_403_form =
-    "You do not have permission to get file form this server.\n";
-const char *error_404_title = "Not Found";
-const char *error_404_form =
-    "The requested file was not found on this server.\n";
-const char *error_500_title = "Internal Error";
-const char *error_500_form =
-    "There was an unusual problem serving the request file.\n";
-
 std::map<std::string, std::string> users;
+// 所有连接共享用户表，注册时会修改
+static std::mutex users_lock;
+// 正在写入数据库的注册用户名，由users_lock保护；写入完成前不出现在users中
+static std::set<std::string> pending_users;
+
+void http_conn::initmysql_result(connection_pool *connPool, int close_log) {
+    // 静态函数没有连接对象，LOG_*宏使用的日志开关由参数传入
+    int m_close_log = close_log;
 
-void http_conn::initmysql_result(connection_pool *connPool) {
     // 先从连接池中取一个连接
     MYSQL *mysql = NULL;
     connectionRAII mysqlcon(&mysql, connPool);
@@ -59,6 +52,7 @@ int setnonblocking(int fd) {
 }
 
 // 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
+// fd在创建时已设为非阻塞(accept4/SOCK_NONBLOCK等)，这里不再fcntl
 void addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
     epoll_event event;
     event.data.fd = fd;
@@ -71,13 +65,6 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
     if (one_shot)
         event.events |= EPOLLONESHOT;
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setnonblocking(fd);
-}
-
-// 从内核时间表删除描述符
-void removefd(int epollfd, int fd) {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
-    close(fd);
 }
 
 // 将事件重置为EPOLLONESHOT
@@ -93,33 +80,30 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode) {
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
-
-// 关闭连接，关闭一个连接，客户总量减一
-void http_conn::close_conn(bool real_close) {
-    if (real_close && (m_sockfd != -1)) {
-        printf("close %d\n", m_sockfd);
-        removefd(m_epollfd, m_sockfd);
-        m_sockfd = -1;
-        m_user_count--;
-    }
-}
+std::atomic<int> http_conn::m_user_count(0);
 
 // 初始化连接,外部调用初始化套接字地址
-void http_conn::init(int sockfd, const sockaddr_in &addr, char *root,
-                     int TRIGMode, int close_log, std::string user,
-                     std::string passwd, std::string sqlname) {
+void http_conn::init(int sockfd, unsigned int io_gen, const sockaddr_in &addr,
+                     int epollfd, completion_queue *cq, char *root, int TRIGMode,
+                     int close_log, std::string user, std::string passwd,
+                     std::string sqlname, long max_body) {
     m_sockfd = sockfd;
+    m_io_gen = io_gen;
+    m_tasks = 0;
     m_address = addr;
+    m_epollfd = epollfd;
+    m_cq = cq;
 
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    // io_uring模式下读写请求由事件循环提交，不注册到epoll
+    if (m_epollfd != -1)
+        addfd(m_epollfd, sockfd, true, m_TRIGMode);
     m_user_count++;
 
     // 当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     doc_root = root;
     m_TRIGMode = TRIGMode;
     m_close_log = close_log;
+    m_max_body = max_body;
 
     strcpy(sql_user, user.c_str());
     strcpy(sql_passwd, passwd.c_str());
@@ -128,9 +112,22 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root,
     init();
 }
 
+// 计数减到0之后连接随时可能被事件循环关闭并复用，回报所需的字段要先取出
+// 旧代数的回报会被事件循环丢弃，不会作用到复用该fd的新连接上
+void http_conn::finish_task() {
+    completion_queue *cq = m_cq;
+    int sockfd = m_sockfd;
+    unsigned int gen = m_io_gen;
+    if (m_tasks.fetch_sub(2) == 3)
+        cq->push(sockfd, gen, 0);
+}
+
 // 初始化新接受的连接
 // check_state默认为分析请求行状态
 void http_conn::init() {
+    // 上一个请求已处理完，等待下一个请求的keep-alive连接不占用缓冲区和文件
+    release_buffers();
+
     mysql = NULL;
     bytes_to_send = 0;
     bytes_have_send = 0;
@@ -140,52 +137,152 @@ void http_conn::init() {
     m_url = 0;
     m_version = 0;
     m_content_length = 0;
-    m_host = 0;
+    m_chunked = false;
+    m_chunk_line_open = false;
+    m_headers.clear();
+    m_accept_gzip = false;
+    m_gzip_body = false;
+    m_vary = false;
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
     m_write_idx = 0;
-    cgi = 0;
+    m_string = 0;
+    m_form_len = 0;
+    m_route = 0;
+    m_db_stage = DB_NONE;
     m_state = 0;
     timer_flag = 0;
-    improv = 0;
+    m_resp_count = 0;
+    m_request_start = 0;
+    m_iv_start = 0;
+    m_iv_count = 0;
+}
+
+void http_conn::release_buffers() {
+    release_files();
+    buffer_pool::get_instance()->free(m_read_buf, m_read_size);
+    m_read_buf = NULL;
+    m_read_size = 0;
+    buffer_pool::get_instance()->free(m_write_buf, m_write_size);
+    m_write_buf = NULL;
+    m_write_size = 0;
+}
+
+static char *rebase(char *p, char *from, char *to) {
+    return p ? to + (p - from) : p;
+}
+
+// 一个请求的响应已生成，重置解析状态，从读缓冲区中紧随其后的位置解析下一个请求
+void http_conn::next_request() {
+    m_start_line = m_checked_idx;
+    m_request_start = m_checked_idx;
+    m_check_state = CHECK_STATE_REQUESTLINE;
+    m_linger = false;
+    m_method = GET;
+    m_url = 0;
+    m_version = 0;
+    m_content_length = 0;
+    m_chunked = false;
+    m_chunk_line_open = false;
+    m_headers.clear();
+    m_accept_gzip = false;
+    m_gzip_body = false;
+    m_vary = false;
+    m_string = 0;
+    m_form_len = 0;
+    m_route = 0;
+    m_db_stage = DB_NONE;
+}
+
+// 一批响应发送完毕，尚未处理的后续请求移到读缓冲区开头，没有时归还缓冲区
+void http_conn::finish_batch() {
+    release_files();
+    long left = m_read_idx - m_request_start;
+    if (left <= 0) {
+        init();
+        return;
+    }
+
+    char *from = m_read_buf + m_request_start;
+    memmove(m_read_buf, from, left);
+    m_url = rebase(m_url, from, m_read_buf);
+    m_version = rebase(m_version, from, m_read_buf);
+    m_headers.rebase(from, m_read_buf);
+    m_read_idx = left;
+    m_checked_idx -= m_request_start;
+    m_start_line -= m_request_start;
+    m_request_start = 0;
+
+    m_resp_count = 0;
+    m_write_idx = 0;
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    m_iv_start = 0;
+    m_iv_count = 0;
+    buffer_pool::get_instance()->free(m_write_buf, m_write_size);
+    m_write_buf = NULL;
+    m_write_size = 0;
+}
+
+// 保证读缓冲区还能再放入len字节(另留一个字节给'\0')
+// 首次读到数据时才借用缓冲区，请求头较大时换用更大的缓冲区，
+// 已解析出的指针随数据一起迁移，超过MAX_READ_BUFFER_SIZE时返回false
+bool http_conn::reserve_read(int len) {
+    int need = m_read_idx + len + 1;
+    if (m_read_buf && need <= m_read_size)
+        return true;
+
+    int size = m_read_size ? m_read_size : READ_BUFFER_SIZE;
+    while (size < need)
+        size *= 2;
+    if (size > MAX_READ_BUFFER_SIZE)
+        return false;
 
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
-    memset(m_real_file, '\0', FILENAME_LEN);
+    char *buf = buffer_pool::get_instance()->alloc(size);
+    if (m_read_buf) {
+        memcpy(buf, m_read_buf, m_read_idx);
+        m_url = rebase(m_url, m_read_buf, buf);
+        m_version = rebase(m_version, m_read_buf, buf);
+        m_headers.rebase(m_read_buf, buf);
+        buffer_pool::get_instance()->free(m_read_buf, m_read_size);
+    }
+    m_read_buf = buf;
+    m_read_size = size;
+    return true;
 }
 
 // 从状态机，用于分析出一行内容
 // 返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
 http_conn::LINE_STATUS http_conn::parse_line() {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r') {
-            if ((m_checked_idx + 1) == m_read_idx)
-                return LINE_OPEN;
-            else if (m_read_buf[m_checked_idx + 1] == '\n') {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        } else if (temp == '\n') {
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r') {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+    // 向量化查找行尾，不再逐字节检查
+    const char *end = m_read_buf + m_read_idx;
+    const char *eol = scan_eol(m_read_buf + m_checked_idx, end);
+    m_checked_idx = eol - m_read_buf;
+    if (eol == end)
+        return LINE_OPEN;
+    if (*eol == '\r') {
+        if ((m_checked_idx + 1) == m_read_idx)
+            return LINE_OPEN;
+        else if (m_read_buf[m_checked_idx + 1] == '\n') {
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
     }
-    return LINE_OPEN;
+    if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r') {
+        m_read_buf[m_checked_idx - 1] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
 // 循环读取客户数据，直到无数据可读或对方关闭连接
 // 非阻塞ET工作模式下，需要一次性将数据读完
 bool http_conn::read_once() {
-    if (m_read_idx >= READ_BUFFER_SIZE) {
+    if (!reserve_read(1)) {
         return false;
     }
     int bytes_read = 0;
@@ -193,7 +290,7 @@ bool http_conn::read_once() {
     // LT读取数据
     if (0 == m_TRIGMode) {
         bytes_read = recv(m_sockfd, m_read_buf + m_read_idx,
-                          READ_BUFFER_SIZE - m_read_idx, 0);
+                          m_read_size - 1 - m_read_idx, 0);
         m_read_idx += bytes_read;
 
         if (bytes_read <= 0) {
@@ -205,8 +302,20 @@ bool http_conn::read_once() {
     // ET读数据
     else {
         while (true) {
+            // 缓冲区满且还有未解析的数据(如请求体)时先交给process处理，
+            // 处理完后重新注册EPOLLONESHOT时内核会再次检查可读；
+            // 只有解析器在等待更多数据，即一行跨越了缓冲区时才扩容
+            // 分块请求体停在不完整的行上时解析器无法继续，需要扩容读完这一行
+            if (m_read_buf && m_read_idx + 1 >= m_read_size &&
+                m_checked_idx + 1 < m_read_idx) {
+                if (!m_chunk_line_open)
+                    break;
+                m_chunk_line_open = false;
+            }
+            if (!reserve_read(1))
+                return false;
             bytes_read = recv(m_sockfd, m_read_buf + m_read_idx,
-                              READ_BUFFER_SIZE - m_read_idx, 0);
+                              m_read_size - 1 - m_read_idx, 0);
             if (bytes_read == -1) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
                     break;
@@ -220,29 +329,35 @@ bool http_conn::read_once() {
     }
 }
 
+// io_uring模式下，将事件循环收到的数据拷入读缓冲区
+bool http_conn::append_read(const char *data, int len) {
+    if (!reserve_read(len)) {
+        return false;
+    }
+    memcpy(m_read_buf + m_read_idx, data, len);
+    m_read_idx += len;
+    return true;
+}
+
 // 解析http请求行，获得请求方法，目标url及http版本号
-http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
-    m_url = strpbrk(text, " \t");
-    if (!m_url) {
+http_conn::HTTP_CODE http_conn::parse_request_line(char *text, int len) {
+    http_view method, url, version;
+    if (!scan_request_line(text, text + len, method, url, version))
         return BAD_REQUEST;
-    }
-    *m_url++ = '\0';
-    char *method = text;
-    if (strcasecmp(method, "GET") == 0)
+    if (view_equal(method, "GET", 3))
         m_method = GET;
-    else if (strcasecmp(method, "POST") == 0) {
+    else if (view_equal(method, "POST", 4))
         m_method = POST;
-        cgi = 1;
-    } else
-        return BAD_REQUEST;
-    m_url += strspn(m_url, " \t");
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version)
+    else
         return BAD_REQUEST;
-    *m_version++ = '\0';
-    m_version += strspn(m_version, " \t");
-    if (strcasecmp(m_version, "HTTP/1.1") != 0)
+    if (!view_equal(version, "HTTP/1.1", 8))
         return BAD_REQUEST;
+
+    // 视图直接指向读缓冲区，在分隔处写入'\0'即可当作C字符串使用
+    m_url = text + (url.data - text);
+    m_url[url.len] = '\0';
+    m_version = text + (version.data - text);
+    m_version[version.len] = '\0';
     if (strncasecmp(m_url, "http://", 7) == 0) {
         m_url += 7;
         m_url = strchr(m_url, '/');
@@ -255,84 +370,241 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
 
     if (!m_url || m_url[0] != '/')
         return BAD_REQUEST;
-    // 当url为/时，显示判断界面
-    if (strlen(m_url) == 1)
-        strcat(m_url, "judge.html");
+    m_route = router::get_instance()->find(m_method, m_url);
     m_check_state = CHECK_STATE_HEADER;
     return NO_REQUEST;
 }
 
+// 登录和注册请求的表单需要交给路由的处理函数解析
+bool http_conn::cgi_target() const { return m_route && m_route->form; }
+
 // 解析http请求的一个头部信息
-http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
-    if (text[0] == '\0') {
-        if (m_content_length != 0) {
+http_conn::HTTP_CODE http_conn::parse_headers(char *text, int len) {
+    if (len == 0) {
+        // 同时带Transfer-Encoding和Content-Length时无法确定请求体的边界
+        if (m_chunked && m_headers.get(HDR_CONTENT_LENGTH))
+            return BAD_REQUEST;
+        if (m_chunked || m_content_length != 0) {
+            if (m_content_length > m_max_body)
+                return BODY_TOO_LARGE;
+            m_body_handler =
+                cgi_target() ? &http_conn::form_body : &http_conn::discard_body;
+            m_body_read = 0;
+            m_chunk_state = CHUNK_SIZE;
+            m_chunk_left = 0;
+            m_form_len = 0;
+            m_form[0] = '\0';
             m_check_state = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
         return GET_REQUEST;
-    } else if (strncasecmp(text, "Connection:", 11) == 0) {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
+    }
+
+    http_view name, value;
+    if (!scan_header(text, text + len, name, value))
+        return BAD_REQUEST;
+    char *v = text + (value.data - text);
+    v[value.len] = '\0';
+    HEADER_ID id = header_id(name);
+    if (id == HDR_OTHER) {
+        // 不常用的请求头超过上限时拒绝请求，不静默丢弃
+        return m_headers.add_other(name, v, value.len) ? NO_REQUEST
+                                                       : BAD_REQUEST;
+    }
+    if (!m_headers.add(id, v)) {
+        // 重复的请求头保留第一个，Content-Length不一致时无法确定请求体的边界
+        if (id == HDR_CONTENT_LENGTH && strcmp(m_headers.get(id), v) != 0)
+            return BAD_REQUEST;
+        return NO_REQUEST;
+    }
+    switch (id) {
+    case HDR_CONNECTION:
+        if (view_equal(value, "keep-alive", 10))
             m_linger = true;
-        }
-    } else if (strncasecmp(text, "Content-length:", 15) == 0) {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    } else if (strncasecmp(text, "Host:", 5) == 0) {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    } else {
-        LOG_INFO("oop!unknow header: %s", text);
+        break;
+    case HDR_CONTENT_LENGTH:
+        m_content_length = atol(v);
+        if (m_content_length < 0)
+            return BAD_REQUEST;
+        break;
+    case HDR_ACCEPT_ENCODING:
+        m_accept_gzip = accept_gzip(v);
+        break;
+    case HDR_TRANSFER_ENCODING:
+        // 只支持chunked，其他传输编码无法解码
+        if (!view_equal(value, "chunked", 7))
+            return BAD_REQUEST;
+        m_chunked = true;
+        break;
+    default:
+        break;
     }
     return NO_REQUEST;
 }
 
-// 判断http请求是否被完整读入
-http_conn::HTTP_CODE http_conn::parse_content(char *text) {
-    if (m_read_idx >= (m_content_length + m_checked_idx)) {
-        text[m_content_length] = '\0';
+// 表单请求体保存下来，供do_request解析用户名和密码
+bool http_conn::form_body(const char *data, long len) {
+    if (m_form_len + len >= FORM_SIZE)
+        return false;
+    memcpy(m_form + m_form_len, data, len);
+    m_form_len += len;
+    m_form[m_form_len] = '\0';
+    return true;
+}
+
+// 其他请求不使用请求体，读到即丢弃
+bool http_conn::discard_body(const char *data, long len) { return true; }
+
+// 把读缓冲区中已到达的请求体交给处理函数，并从缓冲区中移除
+// 读缓冲区只需容纳请求头和一次读到的数据，上传占用的内存与请求体大小无关
+http_conn::HTTP_CODE http_conn::parse_content() {
+    if (m_chunked)
+        return parse_chunked();
+    long avail = m_read_idx - m_checked_idx;
+    long chunk = m_content_length - m_body_read;
+    if (chunk > avail)
+        chunk = avail;
+    if (chunk > 0) {
+        if (!(this->*m_body_handler)(m_read_buf + m_checked_idx, chunk)) {
+            // 剩余的请求体无法跳过，响应后关闭连接
+            m_linger = false;
+            return BAD_REQUEST;
+        }
+        consume_body(chunk);
+        m_body_read += chunk;
+    }
+    if (m_body_read == m_content_length) {
         // POST请求中最后为输入的用户名和密码
-        m_string = text;
+        m_string = m_form;
         return GET_REQUEST;
     }
     return NO_REQUEST;
 }
 
+// 已交给处理函数的请求体从读缓冲区中移除，后面可能紧跟流水线中的下一个请求
+void http_conn::consume_body(long len) {
+    memmove(m_read_buf + m_checked_idx, m_read_buf + m_checked_idx + len,
+            m_read_idx - m_checked_idx - len);
+    m_read_idx -= len;
+}
+
+// 分块编码的请求体：解码后的数据交给处理函数，块大小行、块后的空行和尾部头部丢弃
+// 解码后的总长度同样受m_max_body限制
+http_conn::HTTP_CODE http_conn::parse_chunked() {
+    m_chunk_line_open = false;
+    while (true) {
+        char *p = m_read_buf + m_checked_idx;
+        long avail = m_read_idx - m_checked_idx;
+        if (m_chunk_state == CHUNK_DATA) {
+            long n = m_chunk_left < avail ? m_chunk_left : avail;
+            if (n == 0)
+                return NO_REQUEST;
+            if (!(this->*m_body_handler)(p, n)) {
+                m_linger = false;
+                return BAD_REQUEST;
+            }
+            consume_body(n);
+            m_chunk_left -= n;
+            if (m_chunk_left == 0)
+                m_chunk_state = CHUNK_DATA_END;
+            continue;
+        }
+
+        // 其余状态按行处理，行不完整时等待更多数据
+        char *eol = (char *)memchr(p, '\n', avail);
+        if (!eol) {
+            m_chunk_line_open = avail > 0;
+            return avail > CHUNK_LINE_MAX ? BAD_REQUEST : NO_REQUEST;
+        }
+        long line_len = eol - p + 1;
+        long text_len = (eol > p && eol[-1] == '\r') ? eol - p - 1 : eol - p;
+        switch (m_chunk_state) {
+        case CHUNK_SIZE: {
+            // 十六进制的块大小，后面可以跟";扩展"
+            long size = 0;
+            long i = 0;
+            for (; i < text_len; ++i) {
+                char c = p[i];
+                int d;
+                if (c >= '0' && c <= '9')
+                    d = c - '0';
+                else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                    d = (c | 0x20) - 'a' + 10;
+                else
+                    break;
+                if (size > (m_max_body >> 4))
+                    return BODY_TOO_LARGE;
+                size = size * 16 + d;
+            }
+            if (i == 0 || (i < text_len && p[i] != ';' && p[i] != ' ' &&
+                           p[i] != '\t'))
+                return BAD_REQUEST;
+            if (m_body_read + size > m_max_body)
+                return BODY_TOO_LARGE;
+            m_body_read += size;
+            m_chunk_left = size;
+            m_chunk_state = size ? CHUNK_DATA : CHUNK_TRAILER;
+            break;
+        }
+        case CHUNK_DATA_END:
+            if (text_len != 0)
+                return BAD_REQUEST;
+            m_chunk_state = CHUNK_SIZE;
+            break;
+        default:
+            // 尾部头部不使用，空行表示请求体结束
+            if (text_len == 0) {
+                consume_body(line_len);
+                m_string = m_form;
+                return GET_REQUEST;
+            }
+            break;
+        }
+        consume_body(line_len);
+    }
+}
+
 http_conn::HTTP_CODE http_conn::process_read() {
     LINE_STATUS line_status = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
     char *text = 0;
 
+    // 数据库通道接手时请求已解析完，直接执行路由
+    if (m_db_stage == DB_PENDING) {
+        m_db_stage = DB_RESUMED;
+        return do_request();
+    }
+
     while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) ||
            ((line_status = parse_line()) == LINE_OK)) {
         text = get_line();
+        // 行尾的"\r\n"已被parse_line改写为'\0'
+        int len = m_checked_idx - 2 - m_start_line;
         m_start_line = m_checked_idx;
-        LOG_INFO("%s", text);
         switch (m_check_state) {
         case CHECK_STATE_REQUESTLINE: {
-            ret = parse_request_line(text);
+            ret = parse_request_line(text, len);
             if (ret == BAD_REQUEST)
                 return BAD_REQUEST;
             break;
         }
         case CHECK_STATE_HEADER: {
-            ret = parse_headers(text);
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
+            ret = parse_headers(text, len);
+            if (ret == BAD_REQUEST || ret == BODY_TOO_LARGE)
+                return ret;
             else if (ret == GET_REQUEST) {
                 return do_request();
             }
             break;
         }
         case CHECK_STATE_CONTENT: {
-            ret = parse_content(text);
+            ret = parse_content();
             if (ret == GET_REQUEST)
                 return do_request();
-            line_status = LINE_OPEN;
-            break;
+            if (ret == BAD_REQUEST || ret == BODY_TOO_LARGE)
+                return ret;
+            // 请求体尚未完整，不能再按行扫描，否则会越过未解码的块大小行
+            return NO_REQUEST;
         }
         default:
             return INTERNAL_ERROR;
@@ -341,267 +613,688 @@ http_conn::HTTP_CODE http_conn::process_read() {
     return NO_REQUEST;
 }
 
+// 将用户名和密码提取出来
+// user=123&passwd=123
+// 表单长度不超过FORM_SIZE，但仍需防止字段越过name/password的边界
+void http_conn::parse_user(char *name, char *password) {
+    int i = 0, j = 0;
+    if (m_form_len > 5) {
+        for (i = 5; m_string[i] != '&' && m_string[i] != '\0' && j < 99;
+             ++i, ++j)
+            name[j] = m_string[i];
+    }
+    name[j] = '\0';
+
+    j = 0;
+    if (i > 0 && m_string[i] == '&' && i + 10 <= m_form_len) {
+        for (i = i + 10; m_string[i] != '\0' && j < 99; ++i, ++j)
+            password[j] = m_string[i];
+    }
+    password[j] = '\0';
+}
+
+// 固定页面
+const char *http_conn::page_route(const route &r) { return r.page; }
+
+// 登录：浏览器端输入的用户名和密码在表中可以查找到时返回page，否则返回error_page
+const char *http_conn::login_route(const route &r) {
+    char name[100], password[100];
+    parse_user(name, password);
+    std::unique_lock<std::mutex> lock(users_lock);
+    auto it = users.find(name);
+    return it != users.end() && it->second == password ? r.page
+                                                         : r.error_page;
+}
+
+// 注册：先检测数据库中是否有重名的，没有重名的，进行增加数据
+const char *http_conn::register_route(const route &r) {
+    char name[100], password[100];
+    parse_user(name, password);
+    char sql_insert[256];
+    snprintf(sql_insert, sizeof(sql_insert),
+             "INSERT INTO user(username, passwd) VALUES('%s', '%s')", name,
+             password);
+
+    // 锁内只检查并预留用户名，插入数据库时不持锁，登录和用户列表不受影响
+    {
+        std::unique_lock<std::mutex> lock(users_lock);
+        if (users.find(name) != users.end() ||
+            !pending_users.insert(name).second)
+            return r.error_page;
+    }
+    int res;
+    {
+        sqlWaitRAII wait;
+        res = mysql_query(mysql, sql_insert);
+    }
+    // 插入成功才公开给登录和用户列表，失败则撤销预留
+    std::unique_lock<std::mutex> lock(users_lock);
+    pending_users.erase(name);
+    if (res)
+        return r.error_page;
+    users.insert(std::pair<std::string, std::string>(name, password));
+    return r.page;
+}
+
 http_conn::HTTP_CODE http_conn::do_request() {
+    // 每个请求只转交一次，数据库通道上仍取不到连接时按原流程处理
+    if (m_route && m_route->db && !mysql && m_db_stage == DB_NONE) {
+        m_db_stage = DB_PENDING;
+        return DB_REQUEST;
+    }
+    // 流式路由的响应体由生成函数分块生成
+    if (m_route && m_route->stream) {
+        start_stream(m_route->stream);
+        return STREAM_REQUEST;
+    }
     strcpy(m_real_file, doc_root);
     int len = strlen(doc_root);
-    // printf("m_url:%s\n", m_url);
-    const char *p = strrchr(m_url, '/');
-
-    // 处理cgi
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3')) {
-
-        // 根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        // 将用户名和密码提取出来
-        // user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-        if (*(p + 1) == '3') {
-            // 如果是注册，先检测数据库中是否有重名的
-            // 没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end()) {
-                std::unique_lock<std::mutex> lock(m_lock);
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(
-                    std::pair<std::string, std::string>(name, password));
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
-            } else
-                strcpy(m_url, "/registerError.html");
+    // 命中路由时由处理函数决定发送的页面，否则按url查找静态文件
+    const char *page = m_route ? (this->*m_route->handler)(*m_route) : m_url;
+    strncpy(m_real_file + len, page, FILENAME_LEN - len - 1);
+    m_real_file[FILENAME_LEN - 1] = '\0';
+
+    // 命中缓存时响应头和文件内容都已生成，不再访问文件系统
+    file_cache *cache = file_cache::get_instance();
+    unsigned int gen = cache->generation();
+    m_entry = cache->lookup(m_real_file, m_accept_gzip);
+    if (m_entry)
+        return FILE_REQUEST;
+
+    // 大文件的fd和stat结果也有缓存，命中时不再stat/open
+    // fd耗尽等情况下打开失败时返回500
+    m_file = open_file_cache::get_instance()->acquire(m_real_file);
+    if (!m_file) {
+        if (errno == ENOENT || errno == ENOTDIR || errno == ENAMETOOLONG)
+            return NO_RESOURCE;
+        if (errno == EACCES)
+            return FORBIDDEN_REQUEST;
+        return INTERNAL_ERROR;
+    }
+    m_file_stat = m_file->st;
+
+    if (!(m_file_stat.st_mode & S_IROTH)) {
+        m_file.reset();
+        return FORBIDDEN_REQUEST;
+    }
+
+    if (S_ISDIR(m_file_stat.st_mode)) {
+        m_file.reset();
+        return BAD_REQUEST;
+    }
+
+    // 文件内容由sendfile直接从页缓存发送，不再mmap
+    if (m_file_stat.st_size == 0) {
+        m_file.reset();
+        return FILE_REQUEST;
+    }
+    int flags = 0;
+    if (cache->compressible(m_real_file, m_file_stat.st_size)) {
+        m_vary = true;
+        flags = file_cache::CACHE_VARY;
+        if (m_accept_gzip && open_gzip(gen))
+            return FILE_REQUEST;
+    }
+    if (cache->cacheable(m_file_stat.st_size)) {
+        m_entry = cache->load(m_real_file, m_file->fd, m_file_stat, gen, flags);
+        if (m_entry) {
+            m_file.reset();
+            return FILE_REQUEST;
         }
-        // 如果是登录，直接判断
-        // 若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2') {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
+    }
+    open_file_cache::get_instance()->insert(m_file);
+    return FILE_REQUEST;
+}
+
+// 取得m_real_file的gzip表示：优先使用同目录下预压缩的.gz文件，
+// 没有时压缩m_file放入缓存；文件过大无法缓存时返回false，发送未压缩的内容
+bool http_conn::open_gzip(unsigned int gen) {
+    file_cache *cache = file_cache::get_instance();
+    char gz_file[FILENAME_LEN + 3];
+    snprintf(gz_file, sizeof(gz_file), "%s.gz", m_real_file);
+    std::shared_ptr<const open_file> gz =
+        open_file_cache::get_instance()->acquire(gz_file);
+    if (gz && S_ISREG(gz->st.st_mode) && (gz->st.st_mode & S_IROTH) &&
+        gz->st.st_size > 0) {
+        m_file.reset();
+        if (cache->cacheable(gz->st.st_size)) {
+            m_entry = cache->load(m_real_file, gz->fd, gz->st, gen,
+                                  file_cache::CACHE_VARY |
+                                      file_cache::CACHE_GZIP);
+            if (m_entry)
+                return true;
         }
+        open_file_cache::get_instance()->insert(gz);
+        m_file = gz;
+        m_file_stat = gz->st;
+        m_gzip_body = true;
+        return true;
     }
 
-    if (*(p + 1) == '0') {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    if (!cache->cacheable(m_file_stat.st_size))
+        return false;
+    m_entry = cache->load(m_real_file, m_file->fd, m_file_stat, gen,
+                          file_cache::CACHE_VARY | file_cache::CACHE_GZIP |
+                              file_cache::CACHE_COMPRESS);
+    if (!m_entry)
+        return false;
+    m_file.reset();
+    return true;
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '1') {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+// 释放响应用到的文件、缓存项和流式响应的缓冲区，没有其他引用时文件在此关闭
+void http_conn::release_files() {
+    m_file.reset();
+    m_entry.reset();
+    for (int i = 0; i < m_resp_count; ++i) {
+        m_resp[i].file.reset();
+        m_resp[i].entry.reset();
+    }
+    m_stream = NULL;
+    buffer_pool::get_instance()->free(m_stream_buf, m_stream_size);
+    m_stream_buf = NULL;
+    m_stream_size = 0;
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '5') {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+// 响应头之后的内容由source分块生成
+void http_conn::start_stream(stream_source source) {
+    m_stream = source;
+    m_cursor.pos = 0;
+    m_cursor.key.clear();
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '6') {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+// 生成流式响应的下一块并追加到发送段，最后一块之后追加结束块"0\r\n\r\n"
+// 每块生成在同一个缓冲区中，发送队列中最多一块，套接字写满时生成也随之暂停
+bool http_conn::add_chunk() {
+    static const int HEAD = 10; // 块大小行，至多8位十六进制加"\r\n"
+    static const int TAIL = 7;  // 块后的"\r\n"和结束块
+    if (!m_stream_buf) {
+        m_stream_size = STREAM_BUFFER_SIZE;
+        m_stream_buf = buffer_pool::get_instance()->alloc(m_stream_size);
+    }
+    char *data = m_stream_buf + HEAD;
+    int n = m_stream(m_cursor, data, m_stream_size - HEAD - TAIL);
+    if (n < 0) {
+        // 已发出的响应头无法撤回，不发结束块，由关闭连接告知客户端响应不完整
+        m_stream = NULL;
+        m_resp[m_resp_count - 1].linger = false;
+        return false;
+    }
+    char *start = data;
+    int len = 0;
+    if (n > 0) {
+        char size[16];
+        int size_len = snprintf(size, sizeof(size), "%x\r\n", n);
+        start = data - size_len;
+        memcpy(start, size, size_len);
+        memcpy(data + n, "\r\n", 2);
+        len = size_len + n + 2;
+    } else {
+        m_stream = NULL;
+    }
+    if (!m_stream) {
+        memcpy(start + len, "0\r\n\r\n", 5);
+        len += 5;
+    }
+    add_iv(start, len);
+    return true;
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '7') {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+// 当前的发送段已全部发出，流式响应还有后续内容时生成下一块
+bool http_conn::next_chunk() {
+    if (!m_stream)
+        return false;
+    m_iv_start = 0;
+    m_iv_count = 0;
+    return add_chunk();
+}
 
-        free(m_url_real);
-    } else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+// 通知所属事件循环下一步关注的事件
+// epoll模式下重置EPOLLONESHOT；io_uring模式下由事件循环提交对应的请求，ev为0表示关闭连接
+void http_conn::rearm(int ev) {
+    if (m_epollfd == -1)
+        m_cq->push(m_sockfd, m_io_gen, ev);
+    else
+        modfd(m_epollfd, m_sockfd, ev, m_TRIGMode);
+}
 
-    if (stat(m_real_file, &m_file_stat) < 0)
-        return NO_RESOURCE;
+// 把一批响应组织成发送段，相邻的响应头合并为一段，文件单独成段
+void http_conn::build_iv() {
+    m_iv_start = 0;
+    m_iv_count = 0;
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    int head_start = 0;
+    for (int i = 0; i < m_resp_count; ++i) {
+        const response &resp = m_resp[i];
+        add_iv(m_write_buf + head_start, resp.head_end - head_start);
+        if (resp.entry && resp.prebuilt) {
+            // keep-alive的响应头和内容连续存放，为一段
+            if (resp.linger) {
+                add_iv(resp.entry->data.data(), resp.entry->data.size());
+            } else {
+                add_iv(resp.entry->close_head.data(),
+                       resp.entry->close_head.size());
+                add_iv(resp.entry->body(), resp.entry->body_len);
+            }
+        } else if (resp.entry) {
+            add_iv(resp.entry->body() + resp.body_off, resp.body_len);
+        } else if (resp.file && resp.body_len > 0) {
+            m_iv[m_iv_count].iov_base = NULL;
+            m_iv[m_iv_count].iov_len = resp.body_len;
+            m_iv_file[m_iv_count].fd = resp.file->fd;
+            m_iv_file[m_iv_count].off = resp.body_off;
+            ++m_iv_count;
+            bytes_to_send += resp.body_len;
+        }
+        head_start = resp.head_end;
+    }
+    // 流式响应总是一批中的最后一个，第一块和响应头一起发出
+    if (m_stream)
+        add_chunk();
+}
 
-    if (!(m_file_stat.st_mode & S_IROTH))
-        return FORBIDDEN_REQUEST;
+// 追加一段内存数据，与上一段相邻时合并
+void http_conn::add_iv(const char *base, size_t len) {
+    if (len == 0)
+        return;
+    bytes_to_send += len;
+    if (m_iv_count > 0) {
+        struct iovec &last = m_iv[m_iv_count - 1];
+        if (last.iov_base && (char *)last.iov_base + last.iov_len == base) {
+            last.iov_len += len;
+            return;
+        }
+    }
+    m_iv[m_iv_count].iov_base = (char *)base;
+    m_iv[m_iv_count].iov_len = len;
+    ++m_iv_count;
+}
 
-    if (S_ISDIR(m_file_stat.st_mode))
-        return BAD_REQUEST;
+// 已发送bytes字节，跳过发送完的段并调整第一个未发完的段
+void http_conn::update_iv(int bytes) {
+    bytes_have_send += bytes;
+    bytes_to_send -= bytes;
+    while (bytes > 0 && m_iv_start < m_iv_count) {
+        struct iovec &iv = m_iv[m_iv_start];
+        if ((size_t)bytes >= iv.iov_len) {
+            bytes -= iv.iov_len;
+            iv.iov_len = 0;
+            ++m_iv_start;
+        } else {
+            if (iv.iov_base)
+                iv.iov_base = (char *)iv.iov_base + bytes;
+            else
+                m_iv_file[m_iv_start].off += bytes;
+            iv.iov_len -= bytes;
+            bytes = 0;
+        }
+    }
+}
 
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address =
-        (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
+struct msghdr *http_conn::get_msg(int &flags) {
+    int n = 0;
+    while (m_iv_start + n < m_iv_count && m_iv[m_iv_start + n].iov_base)
+        ++n;
+    if (n == 0)
+        return NULL;
+    // 响应头后面紧跟文件时暂不发出，和文件开头合并成完整的报文段
+    flags = m_iv_start + n < m_iv_count ? MSG_MORE : 0;
+    memset(&m_msg, 0, sizeof(m_msg));
+    m_msg.msg_iov = m_iv + m_iv_start;
+    m_msg.msg_iovlen = n;
+    return &m_msg;
 }
-void http_conn::unmap() {
-    if (m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+
+int http_conn::send_file() {
+    const struct iovec &iv = m_iv[m_iv_start];
+    size_t len = iv.iov_len < (size_t)SENDFILE_CHUNK ? iv.iov_len : SENDFILE_CHUNK;
+    off_t off = m_iv_file[m_iv_start].off;
+    int ret = sendfile(m_sockfd, m_iv_file[m_iv_start].fd, &off, len);
+    // 文件在发送过程中被截断，无法再发出Content-Length承诺的长度
+    if (ret == 0) {
+        errno = EIO;
+        return -1;
     }
+    return ret;
 }
-bool http_conn::write() {
+
+bool http_conn::write(bool &more) {
     int temp = 0;
 
+    more = false;
+    // 重新注册事件后连接可能立即交给其他工作线程，须先归还缓冲区
     if (bytes_to_send == 0) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         init();
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         return true;
     }
 
     while (1) {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
-
+        int flags = 0;
+        struct msghdr *msg = get_msg(flags);
+        if (msg)
+            temp = sendmsg(m_sockfd, msg, flags);
+        else
+            temp = send_file();
+
+        // 套接字写满时等待下一次EPOLLOUT，从记录的偏移处继续发送
         if (temp < 0) {
             if (errno == EAGAIN) {
                 modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
                 return true;
             }
-            unmap();
+            release_files();
             return false;
         }
 
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-        if (bytes_have_send >= m_iv[0].iov_len) {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        } else {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-        }
+        update_iv(temp);
 
         if (bytes_to_send <= 0) {
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-
-            if (m_linger) {
-                init();
-                return true;
-            } else {
+            if (next_chunk())
+                continue;
+            if (!batch_linger()) {
+                release_files();
                 return false;
             }
+
+            // 读缓冲区中还有后续请求时由调用方继续处理，不重新注册读事件
+            finish_batch();
+            more = has_buffered_request();
+            if (!more)
+                modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+            return true;
         }
     }
 }
-bool http_conn::add_response(const char *format, ...) {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;
-    va_list arg_list;
-    va_start(arg_list, format);
-    int len = vsnprintf(m_write_buf + m_write_idx,
-                        WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)) {
-        va_end(arg_list);
+
+// io_uring模式下sendmsg完成bytes字节后调用
+// 返回false表示需要关闭连接，pending为true表示仍有数据待发送
+bool http_conn::complete_write(int bytes, bool &pending) {
+    update_iv(bytes);
+    if (bytes_to_send > 0 || next_chunk()) {
+        pending = true;
+        return true;
+    }
+
+    pending = false;
+    if (!batch_linger()) {
+        release_files();
         return false;
     }
-    m_write_idx += len;
-    va_end(arg_list);
+    finish_batch();
+    return true;
+}
 
-    LOG_INFO("request:%s", m_write_buf);
+// 写缓冲区按需从buffer_pool借用，末尾保留一个字节
+char *http_conn::write_space(int len) {
+    if (!m_write_buf) {
+        m_write_size = WRITE_BUFFER_SIZE;
+        m_write_buf = buffer_pool::get_instance()->alloc(m_write_size);
+    }
+    if (m_write_idx + len >= WRITE_BUFFER_SIZE)
+        return NULL;
+    return m_write_buf + m_write_idx;
+}
 
+bool http_conn::add_text(const char *text, int len) {
+    char *p = write_space(len);
+    if (!p)
+        return false;
+    memcpy(p, text, len);
+    m_write_idx += len;
     return true;
 }
-bool http_conn::add_status_line(int status, const char *title) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+
+bool http_conn::add_status_line(int status) {
+    return add_text(status_line(status));
 }
-bool http_conn::add_headers(int content_len) {
+
+bool http_conn::add_headers(long content_len) {
     return add_content_length(content_len) && add_linger() && add_blank_line();
 }
-bool http_conn::add_content_length(int content_len) {
-    return add_response("Content-Length:%d\r\n", content_len);
+
+bool http_conn::add_content_length(long content_len) {
+    char *p = write_space(CONTENT_LENGTH_MAX);
+    if (!p)
+        return false;
+    m_write_idx += fmt_content_length(p, content_len);
+    return true;
 }
+
+// len为0时为416的"bytes */size"
+bool http_conn::add_content_range(long start, long len, long size) {
+    char *p = write_space(CONTENT_RANGE_MAX);
+    if (!p)
+        return false;
+    m_write_idx += fmt_content_range(p, start, len, size);
+    return true;
+}
+
 bool http_conn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return add_text(CONTENT_TYPE_HTML);
 }
+
 bool http_conn::add_linger() {
-    return add_response("Connection:%s\r\n",
-                        (m_linger == true) ? "keep-alive" : "close");
+    return add_text(m_linger ? CONNECTION_KEEP_ALIVE : CONNECTION_CLOSE);
 }
-bool http_conn::add_blank_line() { return add_response("%s", "\r\n"); }
-bool http_conn::add_content(const char *content) {
-    return add_response("%s", content);
+
+// 与缓存项预先生成的响应头使用同一个函数，二者不会不一致
+bool http_conn::add_file_headers(const char *etag, const char *last_modified,
+                                 bool gzip, bool vary) {
+    char *p = write_space(FILE_HEADERS_MAX);
+    if (!p)
+        return false;
+    m_write_idx += fmt_file_headers(p, etag, last_modified, gzip, vary);
+    return true;
+}
+
+bool http_conn::add_blank_line() { return add_text("\r\n", 2); }
+
+// 错误页等固定响应整体拷贝
+bool http_conn::add_canned(int status) {
+    return add_text(canned_response(status, m_linger));
 }
+
+// 出错的请求响应后关闭连接，不再把同一连接上剩余的数据当作下一个请求解析，
+// 以免未读完的请求体被当作新请求处理(请求走私)
 bool http_conn::process_write(HTTP_CODE ret) {
     switch (ret) {
     case INTERNAL_ERROR: {
-        add_status_line(500, error_500_title);
-        add_headers(strlen(error_500_form));
-        if (!add_content(error_500_form))
+        m_linger = false;
+        if (!add_canned(500))
             return false;
         break;
     }
-    case BAD_REQUEST: {
-        add_status_line(404, error_404_title);
-        add_headers(strlen(error_404_form));
-        if (!add_content(error_404_form))
+    case BODY_TOO_LARGE: {
+        m_linger = false;
+        if (!add_canned(413))
+            return false;
+        break;
+    }
+    case BAD_REQUEST:
+    case NO_RESOURCE: {
+        m_linger = false;
+        if (!add_canned(404))
             return false;
         break;
     }
     case FORBIDDEN_REQUEST: {
-        add_status_line(403, error_403_title);
-        add_headers(strlen(error_403_form));
-        if (!add_content(error_403_form))
+        m_linger = false;
+        if (!add_canned(403))
             return false;
         break;
     }
     case FILE_REQUEST: {
-        add_status_line(200, ok_200_title);
-        if (m_file_stat.st_size != 0) {
-            add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
-            return true;
-        } else {
-            const char *ok_string = "<html><body></body></html>";
-            add_headers(strlen(ok_string));
-            if (!add_content(ok_string))
-                return false;
+        if (m_entry || m_file_stat.st_size != 0)
+            return add_file_response();
+        if (!add_canned(200))
+            return false;
+        break;
+    }
+    case STREAM_REQUEST: {
+        if (!(add_status_line(200) && add_content_type() &&
+              add_text(TRANSFER_ENCODING_CHUNKED) && add_linger() &&
+              add_blank_line())) {
+            m_stream = NULL;
+            return false;
         }
+        break;
     }
     default:
         return false;
     }
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+    push_response(false, 0, 0);
     return true;
 }
-void http_conn::process() {
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        return;
+
+// 已生成的响应入队，m_file/m_entry随响应一起转交，发送完毕后统一释放
+void http_conn::push_response(bool prebuilt, off_t body_off, off_t body_len) {
+    int head_start = m_resp_count > 0 ? m_resp[m_resp_count - 1].head_end : 0;
+    if (m_write_idx > head_start)
+        LOG_INFO("response:%.*s", m_write_idx - head_start,
+                 m_write_buf + head_start);
+    response &resp = m_resp[m_resp_count++];
+    resp.head_end = m_write_idx;
+    resp.file = m_file;
+    resp.entry = m_entry;
+    resp.prebuilt = prebuilt;
+    resp.body_off = body_off;
+    resp.body_len = body_len;
+    resp.linger = m_linger;
+    m_file.reset();
+    m_entry.reset();
+}
+
+// If-None-Match优先，存在时不再看If-Modified-Since
+bool http_conn::not_modified(const char *etag, time_t mtime) const {
+    const char *if_none_match = m_headers.get(HDR_IF_NONE_MATCH);
+    if (if_none_match)
+        return etag_match(if_none_match, etag);
+    const char *if_modified_since = m_headers.get(HDR_IF_MODIFIED_SINCE);
+    time_t since;
+    if (if_modified_since && parse_http_date(if_modified_since, since))
+        return mtime <= since;
+    return false;
+}
+
+// 静态文件的响应：304、416、206或200，文件内容来自缓存项或打开的文件
+bool http_conn::add_file_response() {
+    off_t size;
+    time_t mtime;
+    char etag_buf[ETAG_LEN];
+    const char *etag;
+    bool gzip, vary;
+    if (m_entry) {
+        size = m_entry->body_len;
+        mtime = m_entry->mtime;
+        etag = m_entry->etag.c_str();
+        gzip = m_entry->gzip;
+        vary = m_entry->vary;
+    } else {
+        size = m_file_stat.st_size;
+        mtime = m_file_stat.st_mtime;
+        make_etag(mtime, size, etag_buf);
+        etag = etag_buf;
+        gzip = m_gzip_body;
+        vary = m_vary;
     }
-    bool write_ret = process_write(read_ret);
-    if (!write_ret) {
-        close_conn();
+
+    if (not_modified(etag, mtime)) {
+        char last_modified[HTTP_DATE_LEN];
+        http_date(mtime, last_modified);
+        m_file.reset();
+        m_entry.reset();
+        if (!(add_status_line(304) &&
+              add_file_headers(etag, last_modified, false, vary) &&
+              add_linger() && add_blank_line()))
+            return false;
+        push_response(false, 0, 0);
+        return true;
+    }
+
+    // If-Range与当前版本不一致时忽略Range，返回完整内容
+    off_t start = 0, len = size;
+    RANGE_RESULT range = RANGE_NONE;
+    const char *range_value = m_headers.get(HDR_RANGE);
+    if (range_value && m_method == GET) {
+        const char *if_range = m_headers.get(HDR_IF_RANGE);
+        time_t date;
+        if (!if_range || (if_range[0] == '"' && strcmp(if_range, etag) == 0) ||
+            (parse_http_date(if_range, date) && date == mtime))
+            range = parse_range(range_value, size, start, len);
+    }
+
+    if (range == RANGE_UNSATISFIABLE) {
+        m_file.reset();
+        m_entry.reset();
+        if (!(add_status_line(416) && add_content_range(0, 0, size) &&
+              add_headers(0)))
+            return false;
+        push_response(false, 0, 0);
+        return true;
+    }
+
+    // 缓存项自带完整的200响应头，写缓冲区中不再生成
+    if (range == RANGE_NONE && m_entry) {
+        push_response(true, 0, size);
+        return true;
+    }
+
+    char last_modified[HTTP_DATE_LEN];
+    http_date(mtime, last_modified);
+    bool ok;
+    if (range == RANGE_OK) {
+        ok = add_status_line(206) && add_content_range(start, len, size);
+    } else {
+        ok = add_status_line(200);
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+    ok = ok && add_content_length(len) &&
+         add_file_headers(etag, last_modified, gzip, vary) && add_linger() &&
+         add_blank_line();
+    if (!ok) {
+        m_file.reset();
+        m_entry.reset();
+        return false;
+    }
+    push_response(false, start, len);
+    return true;
+}
+
+// 依次处理读缓冲区中的所有完整请求(HTTP/1.1流水线)，响应按请求顺序排队后合并发送
+// 重新注册事件之后连接可能已交给其他工作线程，返回值须在此之前确定
+bool http_conn::process() {
+    while (m_resp_count < MAX_PIPELINE &&
+           (m_resp_count == 0 ||
+            m_write_idx + RESPONSE_RESERVE <= WRITE_BUFFER_SIZE)) {
+        HTTP_CODE read_ret = process_read();
+        if (read_ret == NO_REQUEST)
+            break;
+        // 由线程池转交数据库通道，之前排队的响应留到那里一起发送
+        if (read_ret == DB_REQUEST)
+            return false;
+        bool write_ret = process_write(read_ret);
+        if (!write_ret) {
+            // 已有排队的响应时先发出去，发送完毕后关闭连接
+            if (m_resp_count > 0) {
+                m_resp[m_resp_count - 1].linger = false;
+                break;
+            }
+            // 由事件循环关闭，定时器和连接槽随之回收
+            notify_close();
+            return true;
+        }
+        bool linger = m_linger;
+        next_request();
+        if (!linger || m_stream)
+            break;
+    }
+
+    if (m_resp_count == 0) {
+        rearm(EPOLLIN);
+        return true;
+    }
+    build_iv();
+    rearm(EPOLLOUT);
+    return true;
 }
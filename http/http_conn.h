@@ -14,14 +14,24 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <atomic>
 #include <map>
 
 #include "../database/sql_connection_pool.h"
+#include "../io/buffer_pool.h"
+#include "../io/completion_queue.h"
+#include "file_cache.h"
+#include "open_file_cache.h"
+#include "header_table.h"
+#include "http_header.h"
+#include "http_scan.h"
+#include "router.h"
+#include "http_validator.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
 
@@ -29,8 +39,15 @@ class http_conn
 {
 public:
     static const int FILENAME_LEN = 200;
-    static const int READ_BUFFER_SIZE = 2048;
+    static const int READ_BUFFER_SIZE = 2048;  //读缓冲区初始大小，不够时按倍数增长
+    static const int MAX_READ_BUFFER_SIZE = buffer_pool::MAX_SIZE;
     static const int WRITE_BUFFER_SIZE = 1024;
+    static const int MAX_PIPELINE = 16;     //流水线请求一批最多合并发送的响应数
+    static const int RESPONSE_RESERVE = 256; //写缓冲区剩余不足此值时不再处理下一个请求
+    static const int FORM_SIZE = 256;        //登录/注册表单请求体的最大长度
+    static const int SENDFILE_CHUNK = 256 * 1024; //单次sendfile最多发送的字节数
+    static const int STREAM_BUFFER_SIZE = 16 * 1024; //流式响应每块的缓冲区，上一块发完才生成下一块
+    static const int CHUNK_LINE_MAX = 1024;  //分块请求体中块大小行和尾部头部的最大长度
     enum METHOD
     {
         GET = 0,
@@ -58,7 +75,25 @@ public:
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        BODY_TOO_LARGE,
+        STREAM_REQUEST,
+        DB_REQUEST //路由需要数据库连接而当前线程没有，交给数据库通道继续处理
+    };
+    //需要数据库的路由：未转交，已解析完等待数据库通道，已在数据库通道上继续
+    enum DB_STAGE
+    {
+        DB_NONE = 0,
+        DB_PENDING,
+        DB_RESUMED
+    };
+    //分块编码请求体的解码状态
+    enum CHUNK_STATE
+    {
+        CHUNK_SIZE = 0,  //块大小行
+        CHUNK_DATA,      //块数据
+        CHUNK_DATA_END,  //块数据后的空行
+        CHUNK_TRAILER    //最后一块之后的尾部头部，到空行为止
     };
     enum LINE_STATUS
     {
@@ -68,79 +103,186 @@ public:
     };
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn()
+        : m_read_buf(NULL), m_read_size(0), m_write_buf(NULL), m_write_size(0),
+          m_resp_count(0), m_stream(NULL), m_stream_buf(NULL),
+          m_stream_size(0) {}
+    ~http_conn() { release_buffers(); }
 
 public:
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, std::string user, std::string passwd, std::string sqlname);
-    void close_conn(bool real_close = true);
-    void process();
+    void init(int sockfd, unsigned int io_gen, const sockaddr_in &addr, int epollfd, completion_queue *cq, char *, int, int, std::string user, std::string passwd, std::string sqlname, long max_body);
+    //返回false表示请求停在需要数据库的路由处，由线程池转交数据库通道
+    bool process();
     bool read_once();
-    bool write();
+    //more为true表示读缓冲区中还有流水线后续请求，没有重新注册读事件，需要调用方继续处理
+    bool write(bool &more);
+    //io_uring模式：由事件循环收发数据，这里只负责拷入数据和推进发送状态
+    bool append_read(const char *data, int len);
+    bool complete_write(int bytes, bool &pending);
+    //待发送数据依次为内存中的响应头和文件段，内存段用sendmsg发送，文件段用sendfile发送
+    //get_msg返回从当前位置起连续的内存段，当前为文件段时返回NULL，后面紧跟文件时flags为MSG_MORE
+    struct msghdr *get_msg(int &flags);
+    //从当前文件段发送至多SENDFILE_CHUNK字节，返回值同sendfile，发送进度由update_iv记录
+    int send_file();
+    //响应发送完毕后，读缓冲区中还有流水线后续请求的数据，需要继续交给process处理
+    bool has_buffered_request() const { return bytes_to_send == 0 && m_read_idx > 0; }
+    //连接所处阶段，用于选择超时：没有未处理数据和待发送响应/仍在接收请求头
+    bool is_idle() const { return m_read_idx == 0 && bytes_to_send == 0; }
+    bool in_header() const { return m_check_state != CHECK_STATE_CONTENT; }
+    //process在需要数据库的路由处暂停，线程池转交数据库通道后再次调用process从该路由继续
+    bool db_pending() const { return m_db_stage == DB_PENDING; }
     sockaddr_in *get_address()
     {
         return &m_address;
     }
-    void initmysql_result(connection_pool *connPool);
+    static void initmysql_result(connection_pool *connPool, int close_log);
+    //注册默认的路由，见routes.cpp
+    static void register_routes(router &r);
+    void notify_close() { m_cq->push(m_sockfd, m_io_gen, 0); }
+    //连接交给线程池处理期间不能关闭，否则工作线程会访问已归还的连接槽和缓冲区
+    //投递前start_task，工作线程处理完毕(转交数据库通道的在那里处理完毕)后finish_task
+    void start_task() { m_tasks.fetch_add(2); }
+    void finish_task();
+    //事件循环关闭连接前调用，仍有任务在处理时返回false，由最后一个任务结束后回报关闭
+    bool try_close() { return m_tasks.fetch_or(1) < 2; }
+    //把读写缓冲区还给buffer_pool，连接关闭或请求处理完毕时调用
+    void release_buffers();
     int timer_flag;
-    int improv;
 
 
 private:
     void init();
+    void next_request();
+    void finish_batch();
+    void build_iv();
+    void add_iv(const char *base, size_t len);
+    bool batch_linger() const { return m_resp_count > 0 && m_resp[m_resp_count - 1].linger; }
     HTTP_CODE process_read();
     bool process_write(HTTP_CODE ret);
-    HTTP_CODE parse_request_line(char *text);
-    HTTP_CODE parse_headers(char *text);
-    HTTP_CODE parse_content(char *text);
+    bool add_file_response();
+    bool not_modified(const char *etag, time_t mtime) const;
+    void push_response(bool prebuilt, off_t body_off, off_t body_len);
+    HTTP_CODE parse_request_line(char *text, int len);
+    HTTP_CODE parse_headers(char *text, int len);
+    HTTP_CODE parse_content();
+    HTTP_CODE parse_chunked();
+    void consume_body(long len);
+    bool cgi_target() const;
+    bool form_body(const char *data, long len);
+    bool discard_body(const char *data, long len);
     HTTP_CODE do_request();
+    void parse_user(char *name, char *password);
+    const char *page_route(const route &r);
+    const char *login_route(const route &r);
+    const char *register_route(const route &r);
+    void start_stream(stream_source source);
+    bool add_chunk();
+    bool next_chunk();
+    bool open_gzip(unsigned int gen);
     char *get_line() { return m_read_buf + m_start_line; };
     LINE_STATUS parse_line();
-    void unmap();
-    bool add_response(const char *format, ...);
-    bool add_content(const char *content);
-    bool add_status_line(int status, const char *title);
-    bool add_headers(int content_length);
+    void release_files();
+    bool reserve_read(int len);
+    void rearm(int ev);
+    void update_iv(int bytes);
+    char *write_space(int len);
+    bool add_text(const char *text, int len);
+    bool add_text(const http_text &text) { return add_text(text.data, text.len); }
+    bool add_status_line(int status);
+    bool add_headers(long content_length);
     bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_content_length(long content_length);
+    bool add_content_range(long start, long len, long size);
     bool add_linger();
+    bool add_file_headers(const char *etag, const char *last_modified, bool gzip, bool vary);
     bool add_blank_line();
+    bool add_canned(int status);
 
 public:
-    static int m_epollfd;
-    static int m_user_count;
+    static std::atomic<int> m_user_count;
     MYSQL *mysql;
     int m_state;  //读为0, 写为1
 
 private:
     int m_sockfd;
+    int m_epollfd; //所属reactor的epoll，-1表示由io_uring事件循环管理
+    completion_queue *m_cq; //工作线程向所属事件循环回报的队列
+    unsigned int m_io_gen;  //连接代数，随回报一起提交，事件循环据此识别fd被复用前的回报
+    std::atomic<int> m_tasks; //处理中的任务数*2，最低位表示事件循环已要求关闭
     sockaddr_in m_address;
-    char m_read_buf[READ_BUFFER_SIZE];
+    char *m_read_buf; //按需从buffer_pool借用，末尾始终保留一个字节给'\0'
+    int m_read_size;
     long m_read_idx;
     long m_checked_idx;
     int m_start_line;
-    char m_write_buf[WRITE_BUFFER_SIZE];
+    char *m_write_buf;
+    int m_write_size;
     int m_write_idx;
     CHECK_STATE m_check_state;
     METHOD m_method;
     char m_real_file[FILENAME_LEN];
     char *m_url;
     char *m_version;
-    char *m_host;
+    header_table m_headers; //当前请求的全部请求头，指向读缓冲区
+    bool m_accept_gzip;  //Accept-Encoding接受gzip
+    bool m_gzip_body;    //m_file为预压缩的.gz文件
+    bool m_vary;         //m_file有gzip表示，响应带Vary
     long m_content_length;
+    long m_max_body; //请求体长度上限，超过时返回413
+    //请求体边到达边交给处理函数，不在读缓冲区中累积
+    typedef bool (http_conn::*body_handler)(const char *data, long len);
+    body_handler m_body_handler;
+    long m_body_read;
+    bool m_chunked;           //请求体为分块编码
+    CHUNK_STATE m_chunk_state;
+    long m_chunk_left;        //当前块剩余的字节数
+    bool m_chunk_line_open;   //解析停在不完整的块大小行或尾部头部上
+    char m_form[FORM_SIZE];
+    int m_form_len;
     bool m_linger;
-    char *m_file_address;
+    std::shared_ptr<const open_file> m_file; //do_request打开的文件，生成响应后转交给m_resp
     struct stat m_file_stat;
-    struct iovec m_iv[2];
+    std::shared_ptr<const cache_entry> m_entry; //命中缓存时的响应，不再打开文件
+    //已生成、等待发送的响应，各响应头依次存放在写缓冲区中
+    struct response
+    {
+        int head_end;       //响应头在写缓冲区中的结束位置
+        //响应体来自缓存项或打开的文件，都为空表示响应体在写缓冲区中
+        std::shared_ptr<const open_file> file;
+        std::shared_ptr<const cache_entry> entry;
+        bool prebuilt;      //使用缓存项自带的完整200响应头
+        off_t body_off;     //Range请求时为所请求的范围
+        off_t body_len;
+        bool linger;
+    };
+    response m_resp[MAX_PIPELINE];
+    int m_resp_count;
+    long m_request_start; //当前请求在读缓冲区中的起始位置
+    //iov_base为NULL的是文件段，文件及当前偏移记录在m_iv_file的对应位置
+    //缓存命中时的响应头和内容与写缓冲区不连续，每个响应最多占两段
+    struct iovec m_iv[2 * MAX_PIPELINE];
+    struct file_seg
+    {
+        int fd;
+        off_t off;
+    };
+    file_seg m_iv_file[2 * MAX_PIPELINE];
+    struct msghdr m_msg;
+    int m_iv_start; //第一个未发送完的段
     int m_iv_count;
-    int cgi;        //是否启用的POST
+    const route *m_route; //请求行匹配的路由，NULL表示静态文件
+    int m_db_stage;       //需要数据库的路由所处的阶段，见DB_STAGE
+    //流式响应，以分块编码发送，每次只生成一块，发送完毕后再生成下一块
+    stream_source m_stream;
+    char *m_stream_buf;
+    int m_stream_size;
+    stream_cursor m_cursor;    //生成函数的续接位置
     char *m_string; //存储请求头数据
     int bytes_to_send;
     int bytes_have_send;
     char *doc_root;
 
     std::map<std::string, std::string> m_users;
-    std::mutex m_lock;
     int m_TRIGMode;
     int m_close_log;
 
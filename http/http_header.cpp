@@ -0,0 +1,202 @@
+#include "http_header.h"
+
+#include <string.h>
+
+#include <string>
+
+// 定义http响应的一些状态信息
+static const http_text STATUS_200 = HTTP_TEXT("HTTP/1.1 200 OK\r\n");
+static const http_text STATUS_206 =
+    HTTP_TEXT("HTTP/1.1 206 Partial Content\r\n");
+static const http_text STATUS_304 =
+    HTTP_TEXT("HTTP/1.1 304 Not Modified\r\n");
+static const http_text STATUS_400 = HTTP_TEXT("HTTP/1.1 400 Bad Request\r\n");
+static const http_text STATUS_403 = HTTP_TEXT("HTTP/1.1 403 Forbidden\r\n");
+static const http_text STATUS_404 = HTTP_TEXT("HTTP/1.1 404 Not Found\r\n");
+static const http_text STATUS_413 =
+    HTTP_TEXT("HTTP/1.1 413 Payload Too Large\r\n");
+static const http_text STATUS_416 =
+    HTTP_TEXT("HTTP/1.1 416 Range Not Satisfiable\r\n");
+static const http_text STATUS_500 =
+    HTTP_TEXT("HTTP/1.1 500 Internal Error\r\n");
+
+static const char *error_400_form =
+    "Your request has bad syntax or is inherently impossible to staisfy.\n";
+static const char *error_413_form =
+    "The request body is larger than the server is willing to accept.\n";
+static const char *error_403_form =
+    "You do not have permission to get file form this server.\n";
+static const char *error_404_form =
+    "The requested file was not found on this server.\n";
+static const char *error_500_form =
+    "There was an unusual problem serving the request file.\n";
+static const char *empty_200_form = "<html><body></body></html>";
+
+const http_text &status_line(int status) {
+    switch (status) {
+    case 200:
+        return STATUS_200;
+    case 206:
+        return STATUS_206;
+    case 304:
+        return STATUS_304;
+    case 400:
+        return STATUS_400;
+    case 403:
+        return STATUS_403;
+    case 404:
+        return STATUS_404;
+    case 413:
+        return STATUS_413;
+    case 416:
+        return STATUS_416;
+    default:
+        return STATUS_500;
+    }
+}
+
+int fmt_ulong(char *buf, unsigned long v) {
+    static const char digits[] = "00010203040506070809"
+                                 "10111213141516171819"
+                                 "20212223242526272829"
+                                 "30313233343536373839"
+                                 "40414243444546474849"
+                                 "50515253545556575859"
+                                 "60616263646566676869"
+                                 "70717273747576777879"
+                                 "80818283848586878889"
+                                 "90919293949596979899";
+    // 从后往前每次写两位
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        int i = (v % 100) * 2;
+        v /= 100;
+        *--p = digits[i + 1];
+        *--p = digits[i];
+    }
+    if (v >= 10) {
+        *--p = digits[v * 2 + 1];
+        *--p = digits[v * 2];
+    } else {
+        *--p = '0' + v;
+    }
+    int len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    return len;
+}
+
+static const http_text CONTENT_LENGTH = HTTP_TEXT("Content-Length:");
+static const http_text CONTENT_RANGE = HTTP_TEXT("Content-Range:bytes ");
+static const http_text ETAG = HTTP_TEXT("ETag:");
+static const http_text LAST_MODIFIED = HTTP_TEXT("Last-Modified:");
+static const http_text ACCEPT_RANGES = HTTP_TEXT("Accept-Ranges:bytes\r\n");
+static const http_text CONTENT_ENCODING_GZIP =
+    HTTP_TEXT("Content-Encoding:gzip\r\n");
+static const http_text VARY_ACCEPT_ENCODING =
+    HTTP_TEXT("Vary:Accept-Encoding\r\n");
+
+static char *put(char *p, const http_text &text) {
+    memcpy(p, text.data, text.len);
+    return p + text.len;
+}
+
+static char *put_line(char *p, const http_text &name, const char *value) {
+    int len = strlen(value);
+    p = put(p, name);
+    memcpy(p, value, len);
+    p += len;
+    *p++ = '\r';
+    *p++ = '\n';
+    return p;
+}
+
+int fmt_content_length(char *buf, unsigned long len) {
+    char *p = put(buf, CONTENT_LENGTH);
+    p += fmt_ulong(p, len);
+    *p++ = '\r';
+    *p++ = '\n';
+    return p - buf;
+}
+
+int fmt_content_range(char *buf, unsigned long start, unsigned long len,
+                      unsigned long size) {
+    char *p = put(buf, CONTENT_RANGE);
+    if (len == 0) {
+        *p++ = '*';
+    } else {
+        p += fmt_ulong(p, start);
+        *p++ = '-';
+        p += fmt_ulong(p, start + len - 1);
+    }
+    *p++ = '/';
+    p += fmt_ulong(p, size);
+    *p++ = '\r';
+    *p++ = '\n';
+    return p - buf;
+}
+
+int fmt_file_headers(char *buf, const char *etag, const char *last_modified,
+                     bool gzip, bool vary) {
+    char *p = put_line(buf, ETAG, etag);
+    p = put_line(p, LAST_MODIFIED, last_modified);
+    p = put(p, ACCEPT_RANGES);
+    if (gzip)
+        p = put(p, CONTENT_ENCODING_GZIP);
+    if (vary)
+        p = put(p, VARY_ACCEPT_ENCODING);
+    return p - buf;
+}
+
+// 固定响应表，第一次使用时生成，之后只读
+struct canned_table {
+    enum { COUNT = 6 };
+    std::string text[COUNT][2];
+    http_text resp[COUNT][2];
+
+    canned_table() {
+        static const int codes[COUNT] = {200, 400, 403, 404, 413, 500};
+        static const char *const forms[COUNT] = {
+            empty_200_form, error_400_form, error_403_form,
+            error_404_form, error_413_form, error_500_form};
+        for (int i = 0; i < COUNT; ++i) {
+            for (int linger = 0; linger < 2; ++linger) {
+                std::string &s = text[i][linger];
+                const http_text &status = status_line(codes[i]);
+                const http_text &conn =
+                    linger ? CONNECTION_KEEP_ALIVE : CONNECTION_CLOSE;
+                char length[CONTENT_LENGTH_MAX];
+                int len = strlen(forms[i]);
+                s.assign(status.data, status.len);
+                s.append(length, fmt_content_length(length, len));
+                s.append(conn.data, conn.len);
+                s.append("\r\n");
+                s.append(forms[i], len);
+                resp[i][linger].data = s.data();
+                resp[i][linger].len = s.size();
+            }
+        }
+    }
+
+    int index(int status) const {
+        switch (status) {
+        case 200:
+            return 0;
+        case 400:
+            return 1;
+        case 403:
+            return 2;
+        case 404:
+            return 3;
+        case 413:
+            return 4;
+        default:
+            return 5;
+        }
+    }
+};
+
+const http_text &canned_response(int status, bool linger) {
+    static const canned_table table;
+    return table.resp[table.index(status)][linger ? 1 : 0];
+}
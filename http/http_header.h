@@ -0,0 +1,51 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+// 响应头模板：状态行和固定的头部是编译期常量，错误页等固定响应在第一次使用时整体生成，
+// 生成响应时只拷贝模板，Content-Length等可变的数字由fmt_ulong写入，不再逐个vsnprintf
+
+struct http_text {
+    const char *data;
+    int len;
+};
+
+#define HTTP_TEXT(s) \
+    { s, sizeof(s) - 1 }
+
+static const http_text CONNECTION_KEEP_ALIVE =
+    HTTP_TEXT("Connection:keep-alive\r\n");
+static const http_text CONNECTION_CLOSE = HTTP_TEXT("Connection:close\r\n");
+static const http_text CONTENT_TYPE_HTML =
+    HTTP_TEXT("Content-Type:text/html\r\n");
+static const http_text TRANSFER_ENCODING_CHUNKED =
+    HTTP_TEXT("Transfer-Encoding:chunked\r\n");
+
+static const int CONTENT_LENGTH_MAX = 40;
+static const int CONTENT_RANGE_MAX = 80;
+static const int FILE_HEADERS_MAX = 256;
+
+// "HTTP/1.1 200 OK\r\n"，不支持的状态码返回500的状态行
+const http_text &status_line(int status);
+
+// 固定的完整响应(状态行、Content-Length、Connection和响应体)，linger为keep-alive
+// 支持400/403/404/413/500的错误页和空文件的200
+const http_text &canned_response(int status, bool linger);
+
+// 十进制写入buf，不加'\0'，返回长度，buf至少20字节
+int fmt_ulong(char *buf, unsigned long v);
+
+// "Content-Length:len\r\n"，返回长度，buf至少CONTENT_LENGTH_MAX字节
+int fmt_content_length(char *buf, unsigned long len);
+
+// 206的"Content-Range:bytes start-end/size\r\n"，len为0时写416的"bytes */size"
+// 返回长度，buf至少CONTENT_RANGE_MAX字节
+int fmt_content_range(char *buf, unsigned long start, unsigned long len,
+                      unsigned long size);
+
+// 静态文件响应的ETag、Last-Modified、Accept-Ranges，gzip表示加Content-Encoding，
+// 有gzip表示的文件加Vary；缓存项预先生成的响应头和http_conn动态生成的都由此写入
+// 返回长度，buf至少FILE_HEADERS_MAX字节
+int fmt_file_headers(char *buf, const char *etag, const char *last_modified,
+                     bool gzip, bool vary);
+
+#endif
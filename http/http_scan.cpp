@@ -0,0 +1,163 @@
+#include "http_scan.h"
+
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+typedef const char *(*scan_fn)(const char *, const char *, char, char);
+
+static const char *scan_any_scalar(const char *p, const char *end, char a,
+                                   char b) {
+    for (; p < end; ++p) {
+        if (*p == a || *p == b)
+            return p;
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+// pcmpestri一次在16字节中查找字符集合{a, b}
+__attribute__((target("sse4.2"))) static const char *
+scan_any_sse42(const char *p, const char *end, char a, char b) {
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(set, 2, v, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                                   _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16)
+            return p + idx;
+        p += 16;
+    }
+    return scan_any_scalar(p, end, a, b);
+}
+
+// 一次比较32字节，两次比较结果合并后取最低位
+__attribute__((target("avx2"))) static const char *
+scan_any_avx2(const char *p, const char *end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi8(v, va),
+                                     _mm256_cmpeq_epi8(v, vb));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(eq);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    // 剩余不足32字节时再用16字节比较一次，减少逐字节处理的尾部
+    if (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i eq = _mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(va)),
+                                  _mm_cmpeq_epi8(v, _mm256_castsi256_si128(vb)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(eq);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scan_any_scalar(p, end, a, b);
+}
+#endif
+
+static scan_fn select_default(const char **name) {
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return scan_any_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        *name = "sse4.2";
+        return scan_any_sse42;
+    }
+#endif
+    *name = "scalar";
+    return scan_any_scalar;
+}
+
+static const char *g_scan_name;
+static scan_fn g_scan = select_default(&g_scan_name);
+
+const char *scan_any(const char *p, const char *end, char a, char b) {
+    return g_scan(p, end, a, b);
+}
+
+const char *scan_impl() { return g_scan_name; }
+
+bool scan_select(const char *impl) {
+    if (strcmp(impl, "scalar") == 0) {
+        g_scan = scan_any_scalar;
+        g_scan_name = "scalar";
+        return true;
+    }
+#ifdef HTTP_SCAN_X86
+    if (strcmp(impl, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2")) {
+        g_scan = scan_any_sse42;
+        g_scan_name = "sse4.2";
+        return true;
+    }
+    if (strcmp(impl, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        g_scan = scan_any_avx2;
+        g_scan_name = "avx2";
+        return true;
+    }
+#endif
+    return false;
+}
+
+static const char *skip_blank(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+bool scan_request_line(const char *p, const char *end, http_view &method,
+                       http_view &url, http_view &version) {
+    const char *sp = scan_any(p, end, ' ', '\t');
+    if (sp == end || sp == p)
+        return false;
+    method.data = p;
+    method.len = sp - p;
+
+    p = skip_blank(sp, end);
+    sp = scan_any(p, end, ' ', '\t');
+    if (sp == end || sp == p)
+        return false;
+    url.data = p;
+    url.len = sp - p;
+
+    p = skip_blank(sp, end);
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    if (p == end)
+        return false;
+    version.data = p;
+    version.len = end - p;
+    return true;
+}
+
+bool scan_header(const char *p, const char *end, http_view &name,
+                 http_view &value) {
+    const char *colon = scan_any(p, end, ':', ':');
+    if (colon == end || colon == p || colon[-1] == ' ' || colon[-1] == '\t')
+        return false;
+    name.data = p;
+    name.len = colon - p;
+
+    p = skip_blank(colon + 1, end);
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    value.data = p;
+    value.len = end - p;
+    return true;
+}
+
+bool view_equal(const http_view &v, const char *s, int len) {
+    return v.len == len && strncasecmp(v.data, s, len) == 0;
+}
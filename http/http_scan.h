@@ -0,0 +1,41 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+// 请求行和请求头的向量化扫描
+// 一次比较16(SSE4.2)或32(AVX2)字节查找行尾和分隔符，启动时按CPU选择实现，
+// 不支持时使用逐字节的标量实现；结果以视图的形式指向原缓冲区，不复制数据
+
+// 指向缓冲区中一段字符的视图，不以'\0'结尾
+struct http_view {
+    const char *data;
+    int len;
+};
+
+// 在[p, end)中查找第一个等于a或b的字符，没有时返回end
+const char *scan_any(const char *p, const char *end, char a, char b);
+
+// 查找行尾'\r'或'\n'
+inline const char *scan_eol(const char *p, const char *end) {
+    return scan_any(p, end, '\r', '\n');
+}
+
+// 切分请求行"METHOD SP URL SP VERSION"，分隔可以是多个空格或制表符
+bool scan_request_line(const char *p, const char *end, http_view &method,
+                       http_view &url, http_view &version);
+
+// 切分请求头"name: value"，value去掉首尾空白，冒号前不允许空白
+bool scan_header(const char *p, const char *end, http_view &name,
+                 http_view &value);
+
+// 视图与字符串忽略大小写比较
+bool view_equal(const http_view &v, const char *s, int len);
+
+// 当前使用的实现："avx2"、"sse4.2"或"scalar"
+const char *scan_impl();
+
+// 指定实现，用于基准测试对比，CPU不支持时返回false
+bool scan_select(const char *impl);
+
+#endif
@@ -0,0 +1,128 @@
+#include "http_validator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+void make_etag(time_t mtime, off_t size, char *buf, bool gzip) {
+    snprintf(buf, ETAG_LEN, "\"%lx-%lx%s\"", (unsigned long)mtime,
+             (unsigned long)size, gzip ? "-gz" : "");
+}
+
+void http_date(time_t t, char *buf) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, HTTP_DATE_LEN, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+bool parse_http_date(const char *s, time_t &t) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(s, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0')
+        return false;
+    t = timegm(&tm);
+    return true;
+}
+
+bool etag_match(const char *list, const char *etag) {
+    size_t etag_len = strlen(etag);
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',')
+            ++p;
+        if (*p == '*')
+            return true;
+        if (strncmp(p, "W/", 2) == 0)
+            p += 2;
+        const char *end = p;
+        while (*end && *end != ',')
+            ++end;
+        const char *last = end;
+        while (last > p && (last[-1] == ' ' || last[-1] == '\t'))
+            --last;
+        if ((size_t)(last - p) == etag_len && memcmp(p, etag, etag_len) == 0)
+            return true;
+        p = end;
+    }
+    return false;
+}
+
+bool accept_gzip(const char *list) {
+    int any = -1;
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',')
+            ++p;
+        const char *name = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+            ++p;
+        size_t len = p - name;
+        const char *end = p;
+        while (*end && *end != ',')
+            ++end;
+
+        // 只看第一个参数中的q值，缺省为1
+        double q = 1;
+        const char *param = (const char *)memchr(p, ';', end - p);
+        if (param) {
+            ++param;
+            while (*param == ' ' || *param == '\t')
+                ++param;
+            if ((*param == 'q' || *param == 'Q') && param[1] == '=')
+                q = strtod(param + 2, NULL);
+        }
+        if ((len == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+            (len == 6 && strncasecmp(name, "x-gzip", 6) == 0))
+            return q > 0;
+        if (len == 1 && *name == '*')
+            any = q > 0;
+        p = end;
+    }
+    return any == 1;
+}
+
+RANGE_RESULT parse_range(const char *range, off_t size, off_t &start,
+                         off_t &len) {
+    if (strncmp(range, "bytes=", 6) != 0 || strchr(range, ','))
+        return RANGE_NONE;
+    const char *p = range + 6;
+    char *end;
+
+    // 后缀范围：最后n个字节
+    if (*p == '-') {
+        long long n = strtoll(p + 1, &end, 10);
+        if (end == p + 1 || *end != '\0' || n < 0)
+            return RANGE_NONE;
+        if (n == 0 || size == 0)
+            return RANGE_UNSATISFIABLE;
+        if (n > size)
+            n = size;
+        start = size - n;
+        len = n;
+        return RANGE_OK;
+    }
+
+    if (*p < '0' || *p > '9')
+        return RANGE_NONE;
+    long long first = strtoll(p, &end, 10);
+    if (*end != '-')
+        return RANGE_NONE;
+    p = end + 1;
+    long long last = size - 1;
+    if (*p != '\0') {
+        if (*p < '0' || *p > '9')
+            return RANGE_NONE;
+        last = strtoll(p, &end, 10);
+        if (*end != '\0' || last < first)
+            return RANGE_NONE;
+        if (last > size - 1)
+            last = size - 1;
+    }
+    if (first >= size)
+        return RANGE_UNSATISFIABLE;
+    start = first;
+    len = last - first + 1;
+    return RANGE_OK;
+}
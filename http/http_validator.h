@@ -0,0 +1,35 @@
+#ifndef HTTP_VALIDATOR_H
+#define HTTP_VALIDATOR_H
+
+#include <sys/types.h>
+#include <time.h>
+
+// 静态文件的缓存校验器(ETag/Last-Modified)、条件请求、Range请求和内容协商的处理
+
+static const int ETAG_LEN = 48;      // ETag缓冲区大小，含引号和'\0'
+static const int HTTP_DATE_LEN = 32; // HTTP日期缓冲区大小
+
+// 与nginx相同，由修改时间和文件大小生成强ETag："mtime-size"(十六进制)
+// 压缩后的表示与原文件内容不同，需要不同的强ETag："mtime-size-gz"
+void make_etag(time_t mtime, off_t size, char *buf, bool gzip = false);
+// IMF-fixdate格式的GMT时间，如"Sun, 06 Nov 1994 08:49:37 GMT"
+void http_date(time_t t, char *buf);
+bool parse_http_date(const char *s, time_t &t);
+
+// If-None-Match的值是否包含etag，按弱比较忽略"W/"前缀，"*"匹配任意
+bool etag_match(const char *list, const char *etag);
+
+// Accept-Encoding是否接受gzip，q=0表示拒绝，"*"匹配未列出的编码
+bool accept_gzip(const char *list);
+
+enum RANGE_RESULT
+{
+    RANGE_NONE = 0,      // 没有Range，或格式不支持(多段等)，返回完整内容
+    RANGE_OK,            // 单段范围，[start, start + len)
+    RANGE_UNSATISFIABLE  // 范围超出文件，返回416
+};
+// 解析"bytes=a-b"、"bytes=a-"、"bytes=-n"
+RANGE_RESULT parse_range(const char *range, off_t size, off_t &start,
+                         off_t &len);
+
+#endif
@@ -0,0 +1,124 @@
+#include "open_file_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../log/log.h"
+#include "../timer/lst_timer.h"
+
+open_file::~open_file() {
+    if (fd != -1)
+        close(fd);
+}
+
+void open_file_cache::init(int max_entries, int valid_ms, int close_log) {
+    m_max_entries = max_entries;
+    m_valid_ms = valid_ms;
+    m_close_log = close_log;
+}
+
+std::shared_ptr<const open_file> open_file_cache::acquire(const char *path) {
+    if (m_max_entries > 0) {
+        std::shared_ptr<const open_file> file = lookup(path);
+        if (file) {
+            ++m_hits;
+            return file;
+        }
+        ++m_misses;
+    }
+
+    std::shared_ptr<open_file> file = std::make_shared<open_file>();
+    file->path = path;
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0)
+        return std::shared_ptr<const open_file>();
+    if (fstat(file->fd, &file->st) < 0) {
+        int err = errno;
+        file.reset();
+        errno = err;
+        return std::shared_ptr<const open_file>();
+    }
+    file->validated = monotonic_ms();
+    // 按顺序读取整个文件，提示内核加大预读
+    if (S_ISREG(file->st.st_mode))
+        posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return file;
+}
+
+// 命中且在有效期内时直接返回；超过有效期时重新stat，文件未变化则顺延有效期
+std::shared_ptr<const open_file> open_file_cache::lookup(const char *path) {
+    std::shared_ptr<open_file> file;
+    long long now = monotonic_ms();
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_index.find(path);
+        if (it == m_index.end())
+            return std::shared_ptr<const open_file>();
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        file = *it->second;
+        if (now - file->validated < m_valid_ms)
+            return file;
+    }
+
+    if (!revalidate(file)) {
+        ++m_reopens;
+        erase(file);
+        return std::shared_ptr<const open_file>();
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    file->validated = now;
+    return file;
+}
+
+// 路径仍指向同一个文件，且内容和权限都没有变化
+bool open_file_cache::revalidate(const std::shared_ptr<const open_file> &file) {
+    struct stat st;
+    if (stat(file->path.c_str(), &st) < 0)
+        return false;
+    const struct stat &old = file->st;
+    return st.st_dev == old.st_dev && st.st_ino == old.st_ino &&
+           st.st_size == old.st_size &&
+           st.st_mtim.tv_sec == old.st_mtim.tv_sec &&
+           st.st_mtim.tv_nsec == old.st_mtim.tv_nsec &&
+           st.st_ctim.tv_sec == old.st_ctim.tv_sec &&
+           st.st_ctim.tv_nsec == old.st_ctim.tv_nsec;
+}
+
+void open_file_cache::erase(const std::shared_ptr<const open_file> &file) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_index.find(file->path);
+    // 其他线程可能已经换成了新打开的文件
+    if (it == m_index.end() || *it->second != file)
+        return;
+    m_lru.erase(it->second);
+    m_index.erase(it);
+}
+
+void open_file_cache::insert(const std::shared_ptr<const open_file> &file) {
+    if (m_max_entries <= 0 || !S_ISREG(file->st.st_mode))
+        return;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_index.count(file->path))
+        return;
+    m_lru.push_front(std::const_pointer_cast<open_file>(file));
+    m_index[file->path] = m_lru.begin();
+    while ((int)m_lru.size() > m_max_entries) {
+        m_index.erase(m_lru.back()->path);
+        m_lru.pop_back();
+    }
+}
+
+void open_file_cache::log_stats() {
+    if (m_max_entries <= 0)
+        return;
+    size_t entries;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        entries = m_lru.size();
+    }
+    LOG_INFO("open file cache: hits %ld, misses %ld, reopens %ld, entries "
+             "%zu/%d",
+             m_hits.load(), m_misses.load(), m_reopens.load(), entries,
+             m_max_entries);
+}
@@ -0,0 +1,71 @@
+#ifndef OPEN_FILE_CACHE_H
+#define OPEN_FILE_CACHE_H
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 打开的文件及其属性，最后一个引用释放时关闭fd
+struct open_file {
+    std::string path;
+    int fd;
+    struct stat st;
+    long long validated; // 上次确认文件未变化的时间，毫秒
+
+    open_file() : fd(-1), validated(0) {}
+    ~open_file();
+};
+
+// 缓存打开的fd和stat结果，类似nginx的open_file_cache
+// 用于超过file_cache对象上限、只能sendfile的大文件，命中时不再stat/open/close；
+// 缓存项超过valid毫秒后重新stat一次，文件被替换或修改时重新打开；
+// 项数超过上限时淘汰最久未使用的，正在发送的响应仍持有引用，fd在发送完毕后才关闭
+class open_file_cache {
+  public:
+    static open_file_cache *get_instance() {
+        static open_file_cache instance;
+        return &instance;
+    }
+
+    // max_entries为0时关闭缓存，每次都重新打开
+    void init(int max_entries, int valid_ms, int close_log);
+
+    // 取得path对应的打开的文件，失败时返回空，errno为open/fstat的错误
+    std::shared_ptr<const open_file> acquire(const char *path);
+    // 把acquire新打开的普通文件放入缓存，已在缓存中时不做处理
+    void insert(const std::shared_ptr<const open_file> &file);
+
+    void log_stats();
+
+  private:
+    open_file_cache()
+        : m_max_entries(0), m_valid_ms(0), m_close_log(1), m_hits(0),
+          m_misses(0), m_reopens(0) {}
+    ~open_file_cache() {}
+
+    std::shared_ptr<const open_file> lookup(const char *path);
+    bool revalidate(const std::shared_ptr<const open_file> &file);
+    void erase(const std::shared_ptr<const open_file> &file);
+
+  private:
+    typedef std::list<std::shared_ptr<open_file>> lru_list;
+
+    int m_max_entries;
+    int m_valid_ms;
+    int m_close_log;
+
+    std::mutex m_mutex;
+    lru_list m_lru; // 表头为最近使用的项
+    std::unordered_map<std::string, lru_list::iterator> m_index;
+
+    std::atomic<long> m_hits;
+    std::atomic<long> m_misses;
+    std::atomic<long> m_reopens; // 重新验证时发现文件已变化的次数
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "router.h"
+
+#include <string.h>
+
+// FNV-1a，len为-1时到'\0'或'?'为止，并通过len返回长度
+static unsigned int path_hash(const char *path, int &len) {
+    unsigned int h = 2166136261u;
+    int i = 0;
+    for (; len < 0 ? path[i] && path[i] != '?' : i < len; ++i) {
+        h ^= (unsigned char)path[i];
+        h *= 16777619u;
+    }
+    len = i;
+    return h;
+}
+
+void router::add(int method, const char *path, route_handler handler,
+                 const char *page, const char *error_page, bool form,
+                 bool db) {
+    route r;
+    r.method = method;
+    r.path = path;
+    r.handler = handler;
+    r.page = page;
+    r.error_page = error_page;
+    r.form = form;
+    r.db = db;
+    r.stream = 0;
+    m_routes.push_back(r);
+    rebuild();
+}
+
+void router::add_stream(int method, const char *path, stream_source source) {
+    route r;
+    r.method = method;
+    r.path = path;
+    r.handler = 0;
+    r.page = 0;
+    r.error_page = 0;
+    r.form = false;
+    r.db = false;
+    r.stream = source;
+    m_routes.push_back(r);
+    rebuild();
+}
+
+// 槽数取不小于路由数两倍的2的幂，同一路径的不同方法依次放在相邻的槽
+void router::rebuild() {
+    unsigned int size = 8;
+    while (size < m_routes.size() * 2)
+        size *= 2;
+    m_slots.assign(size, 0);
+    m_mask = size - 1;
+    for (size_t i = 0; i < m_routes.size(); ++i) {
+        int len = -1;
+        unsigned int slot = path_hash(m_routes[i].path, len) & m_mask;
+        while (m_slots[slot])
+            slot = (slot + 1) & m_mask;
+        m_slots[slot] = i + 1;
+    }
+}
+
+const route *router::find(int method, const char *path) const {
+    if (m_slots.empty())
+        return 0;
+    int len = -1;
+    unsigned int slot = path_hash(path, len) & m_mask;
+    for (; m_slots[slot]; slot = (slot + 1) & m_mask) {
+        const route &r = m_routes[m_slots[slot] - 1];
+        if ((r.method == ROUTE_ANY_METHOD || r.method == method) &&
+            strncmp(r.path, path, len) == 0 && r.path[len] == '\0')
+            return &r;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+
+class http_conn;
+struct route;
+
+// 处理函数返回要发送的页面，路径相对doc_root
+typedef const char *(http_conn::*route_handler)(const route &r);
+
+// 流式响应的续接位置，含义由生成函数自行约定，开始时pos为0、key为空
+struct stream_cursor {
+    long pos;
+    std::string key;
+};
+
+// 流式响应的生成函数：从cursor处继续向out写入至多cap字节并更新cursor，
+// 返回写入的字节数，0表示结束，-1表示出错
+typedef int (*stream_source)(stream_cursor &cursor, char *out, int cap);
+
+struct route {
+    int method;            // http_conn::METHOD，ROUTE_ANY_METHOD匹配任意方法
+    const char *path;      // 完整路径，不含查询串
+    route_handler handler;
+    const char *page;      // 处理函数的参数：固定页面或成功时的页面
+    const char *error_page;
+    bool form;             // 需要保留表单请求体
+    bool db;               // 处理函数要访问数据库，转到数据库通道持有连接执行
+    stream_source stream;  // 非空时响应体由它生成，以分块编码流式发送
+};
+
+static const int ROUTE_ANY_METHOD = -1;
+
+// 按方法和路径精确匹配的路由表
+// 启动时注册，之后只读；路径的哈希表用开放定址，查找时不分配内存
+class router {
+  public:
+    static router *get_instance() {
+        static router instance;
+        return &instance;
+    }
+
+    void add(int method, const char *path, route_handler handler,
+             const char *page, const char *error_page = 0, bool form = false,
+             bool db = false);
+    // 流式响应的路由，响应体由source分块生成
+    void add_stream(int method, const char *path, stream_source source);
+    // path到'\0'或'?'为止，没有匹配的路由时返回NULL
+    const route *find(int method, const char *path) const;
+
+  private:
+    router() : m_mask(0) {}
+    ~router() {}
+
+    void rebuild();
+
+  private:
+    std::vector<route> m_routes;
+    std::vector<int> m_slots; // 路由下标加1，0表示空
+    unsigned int m_mask;
+};
+
+#endif
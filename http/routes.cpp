@@ -0,0 +1,20 @@
+#include "http_conn.h"
+
+// 默认的路由，页面中的表单以action="0"等提交到这些路径
+// 新增页面只需在此注册，不必修改http_conn的请求处理流程
+void http_conn::register_routes(router &r) {
+    // 当url为/时，显示判断界面
+    r.add(ROUTE_ANY_METHOD, "/", &http_conn::page_route, "/judge.html");
+    r.add(ROUTE_ANY_METHOD, "/0", &http_conn::page_route, "/register.html");
+    r.add(ROUTE_ANY_METHOD, "/1", &http_conn::page_route, "/log.html");
+    r.add(ROUTE_ANY_METHOD, "/5", &http_conn::page_route, "/picture.html");
+    r.add(ROUTE_ANY_METHOD, "/6", &http_conn::page_route, "/video.html");
+    r.add(ROUTE_ANY_METHOD, "/7", &http_conn::page_route, "/fans.html");
+
+    // 登录和注册需要读取表单中的用户名和密码
+    // 登录只查内存中的用户表；注册要写入数据库，在数据库通道执行
+    r.add(POST, "/2CGISQL.cgi", &http_conn::login_route, "/welcome.html",
+          "/logError.html", true);
+    r.add(POST, "/3CGISQL.cgi", &http_conn::register_route, "/log.html",
+          "/registerError.html", true, true);
+}
@@ -0,0 +1,54 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+
+buffer_pool::~buffer_pool() {
+    for (int n = 0; n < CPU_MAX_NODES; ++n) {
+        for (int i = 0; i < CLASS_NUM; ++i) {
+            for (size_t j = 0; j < m_free[n][i].size(); ++j)
+                ::free(m_free[n][i][j]);
+        }
+    }
+}
+
+// 大小等级：MIN_SIZE << cls
+int buffer_pool::size_class(int size) {
+    int cls = 0;
+    while ((MIN_SIZE << cls) < size)
+        ++cls;
+    return cls;
+}
+
+char *buffer_pool::alloc(int &size) {
+    if (size > MAX_SIZE)
+        return NULL;
+    int cls = size_class(size);
+    size = MIN_SIZE << cls;
+    int node = cpu_affinity::current_group() % CPU_MAX_NODES;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex[node][cls]);
+        std::vector<char *> &list = m_free[node][cls];
+        if (!list.empty()) {
+            char *buf = list.back();
+            list.pop_back();
+            return buf;
+        }
+    }
+    return (char *)malloc(size);
+}
+
+void buffer_pool::free(char *buf, int size) {
+    if (!buf)
+        return;
+    int cls = size_class(size);
+    int node = cpu_affinity::current_group() % CPU_MAX_NODES;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex[node][cls]);
+        std::vector<char *> &list = m_free[node][cls];
+        if ((int)list.size() < MAX_CACHED_BYTES / (MIN_SIZE << cls)) {
+            list.push_back(buf);
+            return;
+        }
+    }
+    ::free(buf);
+}
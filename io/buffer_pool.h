@@ -0,0 +1,42 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <mutex>
+#include <vector>
+
+#include "../threadpool/cpu_affinity.h"
+
+// 连接读写缓冲区的共享池
+// 按1KB到64KB共7个大小等级分配，连接有数据到达时借用，响应发送完毕后归还；
+// 每个等级缓存的空闲缓冲区总量不超过MAX_CACHED_BYTES，多出的直接释放；
+// 启用CPU绑定时空闲缓冲区按当前线程所在的NUMA节点分开缓存，
+// 连接的事件循环和工作线程在同一节点，缓冲区一般在本节点借出和归还
+class buffer_pool {
+  public:
+    static const int MIN_SIZE = 1024;
+    static const int MAX_SIZE = 64 * 1024;
+
+    static buffer_pool *get_instance() {
+        static buffer_pool instance;
+        return &instance;
+    }
+
+    // 借用不小于size的缓冲区，size更新为实际大小，size超过MAX_SIZE时返回NULL
+    char *alloc(int &size);
+    // 归还alloc得到的缓冲区，size为alloc返回的大小
+    void free(char *buf, int size);
+
+  private:
+    buffer_pool() {}
+    ~buffer_pool();
+
+    static const int CLASS_NUM = 7;
+    static const int MAX_CACHED_BYTES = 4 * 1024 * 1024;
+
+    static int size_class(int size);
+
+    std::mutex m_mutex[CPU_MAX_NODES][CLASS_NUM];
+    std::vector<char *> m_free[CPU_MAX_NODES][CLASS_NUM];
+};
+
+#endif
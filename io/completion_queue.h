@@ -0,0 +1,59 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <mutex>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+// 一条处理结果，ev为事件循环下一步关注的事件，0表示需要关闭连接
+// 连接关闭后fd可能很快被新连接复用，事件循环按代数丢弃回报给旧连接的结果
+struct completion {
+    int sockfd;
+    unsigned int gen; // 连接代数，见client_data::io_gen
+    int ev;
+};
+
+// 工作线程向所属事件循环回报处理结果的队列
+// 写入后通过eventfd唤醒事件循环，由事件循环批量取出
+class completion_queue {
+  public:
+    completion_queue() { m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); }
+    ~completion_queue() {
+        if (m_eventfd != -1)
+            close(m_eventfd);
+    }
+
+    int get_fd() const { return m_eventfd; }
+
+    // 工作线程调用
+    void push(int sockfd, unsigned int gen, int ev) {
+        completion item;
+        item.sockfd = sockfd;
+        item.gen = gen;
+        item.ev = ev;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_items.push_back(item);
+        }
+        uint64_t one = 1;
+        ::write(m_eventfd, &one, sizeof(one));
+    }
+
+    // 事件循环调用，一次取出全部待处理元素
+    void drain(std::vector<completion> &items) {
+        uint64_t cnt;
+        while (::read(m_eventfd, &cnt, sizeof(cnt)) > 0) {
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        items.swap(m_items);
+    }
+
+  private:
+    int m_eventfd;
+    std::mutex m_mutex;
+    std::vector<completion> m_items;
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+uring::uring()
+    : m_ring_fd(-1), m_sq_entries(0), m_sqe_tail(0), m_sqe_submit(0),
+      m_sqes(NULL), m_cqes(NULL), m_ring_ptr(NULL), m_ring_size(0),
+      m_sqes_size(0), m_buf_ring(NULL), m_bufs(NULL), m_buf_count(0),
+      m_buf_size(0), m_buf_tail(0) {}
+
+uring::~uring() {
+    if (m_ring_fd != -1)
+        close(m_ring_fd);
+    if (m_sqes)
+        munmap(m_sqes, m_sqes_size);
+    if (m_ring_ptr)
+        munmap(m_ring_ptr, m_ring_size);
+    free(m_buf_ring);
+    free(m_bufs);
+}
+
+bool uring::init(unsigned entries, unsigned buf_count, unsigned buf_size) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_ring_fd = sys_io_uring_setup(entries, &p);
+    if (m_ring_fd < 0)
+        return false;
+
+    // 只支持提交队列和完成队列共用一次mmap的内核(5.4+)
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+        return false;
+
+    // 确认所需的操作码都可用
+    size_t probe_len =
+        sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_len);
+    if (!probe)
+        return false;
+    int ret = sys_io_uring_register(m_ring_fd, IORING_REGISTER_PROBE, probe, 256);
+    const int ops[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+                       IORING_OP_POLL_ADD};
+    bool ok = ret >= 0;
+    for (size_t i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (ops[i] > probe->last_op ||
+            !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+            ok = false;
+    }
+    free(probe);
+    if (!ok)
+        return false;
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    m_ring_size = sq_size > cq_size ? sq_size : cq_size;
+    m_ring_ptr = mmap(NULL, m_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_ring_ptr == MAP_FAILED) {
+        m_ring_ptr = NULL;
+        return false;
+    }
+
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(NULL, m_sqes_size,
+                                         PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                                         IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        m_sqes = NULL;
+        return false;
+    }
+
+    char *ring = (char *)m_ring_ptr;
+    m_sq_head = (unsigned *)(ring + p.sq_off.head);
+    m_sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    m_sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(ring + p.sq_off.array);
+    m_sq_entries = p.sq_entries;
+    m_cq_head = (unsigned *)(ring + p.cq_off.head);
+    m_cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    m_cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    m_sqe_tail = m_sqe_submit = *m_sq_tail;
+
+    // provided buffer环，需要5.19+，同时也保证了多发accept可用
+    if (buf_count == 0 || (buf_count & (buf_count - 1)) || buf_count > 32768)
+        return false;
+    size_t ring_bytes = buf_count * sizeof(struct io_uring_buf);
+    if (posix_memalign((void **)&m_buf_ring, sysconf(_SC_PAGESIZE),
+                       ring_bytes)) {
+        m_buf_ring = NULL;
+        return false;
+    }
+    memset(m_buf_ring, 0, ring_bytes);
+    m_bufs = (char *)malloc((size_t)buf_count * buf_size);
+    if (!m_bufs)
+        return false;
+    m_buf_count = buf_count;
+    m_buf_size = buf_size;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)m_buf_ring;
+    reg.ring_entries = buf_count;
+    reg.bgid = 0;
+    if (sys_io_uring_register(m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) <
+        0)
+        return false;
+
+    for (unsigned i = 0; i < buf_count; ++i)
+        recycle_buf((unsigned short)i);
+
+    return true;
+}
+
+struct io_uring_sqe *uring::get_sqe() {
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries) {
+        // 提交队列已满，先把已准备的请求交给内核
+        submit_and_wait(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries)
+            return NULL;
+    }
+    unsigned idx = m_sqe_tail & *m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[idx] = idx;
+    m_sqe_tail++;
+    return sqe;
+}
+
+bool uring::prep_accept_multishot(int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool uring::prep_recv(int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = m_buf_size;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool uring::prep_sendmsg(int fd, const struct msghdr *msg, int flags,
+                         uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)msg;
+    sqe->len = 1;
+    sqe->msg_flags = flags;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool uring::prep_poll_multishot(int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = user_data;
+    return true;
+}
+
+// 单次poll，触发一次后即结束
+bool uring::prep_poll(int fd, uint64_t user_data, unsigned events) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    return true;
+}
+
+int uring::submit_and_wait(unsigned wait_nr) {
+    unsigned to_submit = m_sqe_tail - m_sqe_submit;
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    m_sqe_submit = m_sqe_tail;
+    if (to_submit == 0 && wait_nr == 0)
+        return 0;
+    return sys_io_uring_enter(m_ring_fd, to_submit, wait_nr,
+                              wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+struct io_uring_cqe *uring::peek_cqe() {
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &m_cqes[head & *m_cq_mask];
+}
+
+void uring::cqe_seen() {
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void uring::recycle_buf(unsigned short bid) {
+    // C++下__DECLARE_FLEX_ARRAY中的空结构体占1字节，bufs的偏移与内核不一致，
+    // 因此直接把环当作io_uring_buf数组访问
+    struct io_uring_buf *buf = (struct io_uring_buf *)m_buf_ring +
+                               (m_buf_tail & (m_buf_count - 1));
+    buf->addr = (unsigned long)buf_addr(bid);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    m_buf_tail++;
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,75 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// 基于io_uring系统调用的最小封装，不依赖liburing
+// 提供多发accept、provided buffer的recv、sendmsg以及poll
+class uring {
+  public:
+    uring();
+    ~uring();
+
+    // 建立提交/完成队列并注册provided buffer环，内核不支持时返回false
+    bool init(unsigned entries, unsigned buf_count, unsigned buf_size);
+
+    // 提交队列已满且提交后仍腾不出位置时返回false，请求未加入
+    bool prep_accept_multishot(int fd, uint64_t user_data);
+    bool prep_recv(int fd, uint64_t user_data);
+    bool prep_sendmsg(int fd, const struct msghdr *msg, int flags,
+                      uint64_t user_data);
+    bool prep_poll_multishot(int fd, uint64_t user_data);
+    bool prep_poll(int fd, uint64_t user_data, unsigned events = POLLIN);
+
+    // 提交所有已准备的请求，并等待至少wait_nr个完成事件
+    int submit_and_wait(unsigned wait_nr);
+
+    // 取出一个完成事件，没有时返回NULL，处理完后调用cqe_seen
+    struct io_uring_cqe *peek_cqe();
+    void cqe_seen();
+
+    // provided buffer相关
+    char *buf_addr(unsigned short bid) {
+        return m_bufs + (size_t)bid * m_buf_size;
+    }
+    void recycle_buf(unsigned short bid);
+
+  private:
+    struct io_uring_sqe *get_sqe();
+
+  private:
+    int m_ring_fd;
+
+    // 提交队列
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned m_sq_entries;
+    unsigned m_sqe_tail;   // 本地已准备的尾部
+    unsigned m_sqe_submit; // 已提交给内核的尾部
+    struct io_uring_sqe *m_sqes;
+
+    // 完成队列
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+
+    void *m_ring_ptr;
+    size_t m_ring_size;
+    size_t m_sqes_size;
+
+    // provided buffer环
+    struct io_uring_buf_ring *m_buf_ring;
+    char *m_bufs;
+    unsigned m_buf_count;
+    unsigned m_buf_size;
+    unsigned short m_buf_tail;
+};
+
+#endif
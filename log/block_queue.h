@@ -1,46 +1,43 @@
-#include <chrono>
-#include <condition_variable>
-#include <iostream>
-#include <mutex>
-#include <queue>
+#ifndef BLOCK_QUEUE_H
+#define BLOCK_QUEUE_H
+
+#include "../threadpool/mpmc_ring.h"
+#include <atomic>
 
 template <typename T> class block_queue {
   public:
-    // Pushes an item to the back of the queue.
-    void push(const T &item) {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_queue.push(item);
-        m_cond.notify_one(); // Wake up one waiting consumer.
+    explicit block_queue(int max_size = 1024) : m_ring(max_size), m_dropped(0) {}
+
+    // Pushes an item to the back of the queue without blocking. When the
+    // queue is full or closed the item is dropped and counted instead, so a
+    // slow consumer never stalls the producers.
+    bool push(const T &item) {
+        if (m_ring.try_push(item))
+            return true;
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
 
+    // Like push(), but a full queue is left to the caller and not counted.
+    bool try_push(const T &item) { return m_ring.try_push(item); }
+
     // Pops an item from the front of the queue, blocking until an item is
-    // available.
-    bool pop(T &item) {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_cond.wait(lock, [this] { return !m_queue.empty(); });
-
-        if (m_queue.empty()) {
-            return false;
-        }
-
-        item = m_queue.front();
-        m_queue.pop();
-        return true;
-    }
+    // available. Returns false once the queue is closed and drained.
+    bool pop(T &item) { return m_ring.pop(item); }
 
-    // Other methods...
-    int size() {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        return m_queue.size();
-    }
+    // Wakes every blocked consumer; pop() drains what is left, then fails.
+    void close() { m_ring.close(); }
 
-    bool empty() {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        return m_queue.empty();
-    }
+    // Number of items dropped by push() so far.
+    long dropped() { return m_dropped.load(std::memory_order_relaxed); }
+
+    int size() { return m_ring.size(); }
+
+    bool empty() { return m_ring.empty(); }
 
   private:
-    std::queue<T> m_queue;
-    std::mutex m_mutex;
-    std::condition_variable m_cond;
-};
\ No newline at end of file
+    mpmc_ring<T> m_ring;
+    std::atomic<long> m_dropped;
+};
+
+#endif
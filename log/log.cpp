@@ -6,20 +6,35 @@
 #include <sys/time.h>
 #include <time.h>
 
-Log::Log() { m_count = 0; }
+Log::Log()
+    : m_count(0), m_fp(NULL), m_buf(NULL), m_log_queue(NULL), m_reported(0),
+      m_is_async(false) {}
 
 Log::~Log() {
+    if (m_log_queue != NULL) {
+        // 关闭队列，写日志线程写完剩余日志后退出
+        m_log_queue->close();
+        pthread_join(m_tid, NULL);
+        if (m_fp != NULL && m_log_queue->dropped() != m_reported)
+            fprintf(m_fp, "%ld log lines dropped\n",
+                    m_log_queue->dropped() - m_reported);
+        delete m_log_queue;
+    }
+    delete[] m_buf;
     if (m_fp != NULL) {
         fclose(m_fp);
     }
 }
 
 bool Log::init(const char *file_name, int close_log, int log_buf_size,
-               int split_lines) {
-    m_log_queue = new block_queue<std::string>();
-    pthread_t tid;
-    // flush_log_thread为回调函数,这里表示创建线程异步写日志
-    pthread_create(&tid, NULL, flush_log_thread, NULL);
+               int split_lines, int max_queue_size) {
+    // 设置了队列长度则为异步
+    if (max_queue_size >= 1) {
+        m_is_async = true;
+        m_log_queue = new block_queue<std::string>(max_queue_size);
+        // flush_log_thread为回调函数,这里表示创建线程异步写日志
+        pthread_create(&m_tid, NULL, flush_log_thread, NULL);
+    }
 
     m_close_log = close_log;
     m_log_buf_size = log_buf_size;
@@ -126,7 +141,11 @@ void Log::write_log(int level, const char *format, ...) {
         log_str = m_buf;
     }
 
-    {
+    if (m_is_async && level != 3) {
+        // 队列满时丢弃并计数
+        m_log_queue->push(log_str);
+    } else if (!m_is_async || !m_log_queue->try_push(log_str)) {
+        // 错误日志不丢弃，队列满时改为同步写入
         std::unique_lock<std::mutex> lock(m_mutex);
         fputs(log_str.c_str(), m_fp);
     }
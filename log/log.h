@@ -23,8 +23,9 @@ class Log {
     }
 
     // 可选择的参数有日志文件、日志缓冲区大小、最大行数以及最长日志条队列
+    // max_queue_size为0时同步写文件，大于0时经由该长度的队列异步写
     bool init(const char *file_name, int close_log, int log_buf_size = 8192,
-              int split_lines = 5000000);
+              int split_lines = 5000000, int max_queue_size = 0);
 
     void write_log(int level, const char *format, ...);
 
@@ -39,6 +40,12 @@ class Log {
         while (m_log_queue->pop(single_log)) {
             std::unique_lock<std::mutex> lock(m_mutex);
             fputs(single_log.c_str(), m_fp);
+            // 队列满时丢弃的条数在下一次写入时补记
+            long dropped = m_log_queue->dropped();
+            if (dropped != m_reported) {
+                fprintf(m_fp, "%ld log lines dropped\n", dropped - m_reported);
+                m_reported = dropped;
+            }
         }
         return nullptr;
     }
@@ -52,7 +59,10 @@ class Log {
     int m_today;        // 因为按天分类,记录当前时间是那一天
     FILE *m_fp;         // 打开log的文件指针
     char *m_buf;
-    block_queue<std::string> *m_log_queue; // 阻塞队列
+    block_queue<std::string> *m_log_queue; // 阻塞队列，满时丢弃并计数
+    long m_reported;                       // 已写入文件的丢弃条数
+    bool m_is_async;                       // 是否异步写日志
+    pthread_t m_tid;                       // 异步写日志线程
     std::mutex m_mutex;
     int m_close_log; // 关闭日志
 };
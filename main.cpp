@@ -15,7 +15,14 @@ int main(int argc, char *argv[]) {
     // 初始化
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite,
                 config.OPT_LINGER, config.TRIGMode, config.sql_num,
-                config.thread_num, config.close_log, config.actor_model);
+                config.thread_num, config.loop_num, config.close_log,
+                config.actor_model, config.uring_mode, config.idle_timeout,
+                config.header_timeout, config.keepalive_timeout,
+                config.max_body, config.backlog, config.cache_size,
+                config.cache_object, config.fd_cache, config.fd_cache_valid,
+                config.gzip_min, config.affinity, config.loop_cpus,
+                config.worker_cpus, config.min_threads, config.max_threads,
+                config.db_threads);
 
     // 日志
     server.log_write();
@@ -26,6 +33,12 @@ int main(int argc, char *argv[]) {
     // 线程池
     server.thread_pool();
 
+    // 静态文件缓存
+    server.static_cache();
+
+    // 路由
+    server.routes();
+
     // 触发模式
     server.trig_mode();
 
@@ -0,0 +1,234 @@
+#include "cpu_affinity.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../log/log.h"
+
+static const char NODE_DIR[] = "/sys/devices/system/node";
+
+// 当前线程绑定到的组
+static thread_local int current_group_id = 0;
+
+// 解析"0-3,8,10-11"格式的CPU列表，空串得到空列表
+static bool parse_cpulist(const char *text, std::vector<int> &cpus) {
+    cpus.clear();
+    const char *p = text;
+    while (p && *p && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE)
+                return false;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+        if (*p == ',')
+            ++p;
+        else if (*p && *p != '\n')
+            return false;
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+// 有序列表格式化为cpulist，连续的编号合并为区间
+static std::string format_cpulist(const std::vector<int> &cpus) {
+    std::string out;
+    char buf[32];
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            ++j;
+        if (j == i)
+            snprintf(buf, sizeof(buf), "%d", cpus[i]);
+        else
+            snprintf(buf, sizeof(buf), "%d-%d", cpus[i], cpus[j]);
+        if (!out.empty())
+            out += ',';
+        out += buf;
+        i = j + 1;
+    }
+    return out.empty() ? "-" : out;
+}
+
+// 读取sysfs中各节点的CPU，按节点号排序；内核未启用NUMA时没有该目录
+static void read_nodes(std::vector<std::pair<int, std::vector<int>>> &nodes) {
+    DIR *dir = opendir(NODE_DIR);
+    if (!dir)
+        return;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        int id;
+        char tail;
+        if (sscanf(ent->d_name, "node%d%c", &id, &tail) != 1)
+            continue;
+        // 目录名最长NAME_MAX，放不下的路径直接跳过
+        char path[sizeof(NODE_DIR) + NAME_MAX + sizeof("/cpulist")];
+        int len = snprintf(path, sizeof(path), "%s/%s/cpulist", NODE_DIR,
+                           ent->d_name);
+        if (len < 0 || (size_t)len >= sizeof(path))
+            continue;
+        FILE *fp = fopen(path, "r");
+        if (!fp)
+            continue;
+        char line[4096];
+        std::vector<int> cpus;
+        if (fgets(line, sizeof(line), fp) && parse_cpulist(line, cpus) &&
+            !cpus.empty())
+            nodes.push_back(std::make_pair(id, cpus));
+        fclose(fp);
+    }
+    closedir(dir);
+    std::sort(nodes.begin(), nodes.end());
+}
+
+void cpu_affinity::init(int enable, const char *loop_cpus,
+                        const char *worker_cpus, int close_log) {
+    m_close_log = close_log;
+    m_enable = false;
+    m_groups.clear();
+    m_loop_groups.clear();
+    m_worker_groups.clear();
+    if (!enable)
+        return;
+
+    std::vector<int> loop_set, worker_set;
+    if (!parse_cpulist(loop_cpus, loop_set) ||
+        !parse_cpulist(worker_cpus, worker_set)) {
+        LOG_WARN("cpu affinity: invalid cpu list \"%s\" / \"%s\", disabled",
+                 loop_cpus, worker_cpus);
+        return;
+    }
+
+    // 进程允许的CPU，可能已被taskset或cgroup限制
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        LOG_WARN("%s", "cpu affinity: sched_getaffinity failed, disabled");
+        return;
+    }
+
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    read_nodes(nodes);
+    if (nodes.empty()) {
+        std::vector<int> all;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            all.push_back(cpu);
+        nodes.push_back(std::make_pair(0, all));
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        cpu_group g;
+        g.node = nodes[i].first;
+        const std::vector<int> &cpus = nodes[i].second;
+        for (size_t j = 0; j < cpus.size(); ++j) {
+            int cpu = cpus[j];
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+            if (loop_set.empty() ||
+                std::binary_search(loop_set.begin(), loop_set.end(), cpu))
+                g.loop.push_back(cpu);
+            if (worker_set.empty() ||
+                std::binary_search(worker_set.begin(), worker_set.end(), cpu))
+                g.worker.push_back(cpu);
+        }
+        if (g.loop.empty() && g.worker.empty())
+            continue;
+        int index = m_groups.size();
+        m_groups.push_back(g);
+        if (!g.loop.empty())
+            m_loop_groups.push_back(index);
+        if (!g.worker.empty())
+            m_worker_groups.push_back(index);
+    }
+
+    if (m_loop_groups.empty() || m_worker_groups.empty()) {
+        LOG_WARN("cpu affinity: no allowed cpu in \"%s\" / \"%s\", disabled",
+                 loop_cpus, worker_cpus);
+        m_groups.clear();
+        m_loop_groups.clear();
+        m_worker_groups.clear();
+        return;
+    }
+    m_enable = true;
+}
+
+// 事件循环依次分到各节点，同一节点上的多个循环依次使用不同的CPU
+int cpu_affinity::loop_group(int index) const {
+    return m_loop_groups[index % m_loop_groups.size()];
+}
+
+int cpu_affinity::loop_cpu(int index) const {
+    const std::vector<int> &cpus = m_groups[loop_group(index)].loop;
+    return cpus[(index / m_loop_groups.size()) % cpus.size()];
+}
+
+int cpu_affinity::worker_group(int index) const {
+    if (!m_enable)
+        return 0;
+    return m_worker_groups[index % m_worker_groups.size()];
+}
+
+bool cpu_affinity::bind(const std::vector<int> &cpus, int group) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i)
+        CPU_SET(cpus[i], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        LOG_WARN("cpu affinity: bind to %s failed: %s",
+                 format_cpulist(cpus).c_str(), strerror(errno));
+        return false;
+    }
+    current_group_id = group;
+    return true;
+}
+
+void cpu_affinity::bind_loop(int index) {
+    if (!m_enable)
+        return;
+    bind(std::vector<int>(1, loop_cpu(index)), loop_group(index));
+}
+
+void cpu_affinity::bind_worker(int index) {
+    if (!m_enable)
+        return;
+    int group = worker_group(index);
+    bind(m_groups[group].worker, group);
+}
+
+int cpu_affinity::current_group() { return current_group_id; }
+
+void cpu_affinity::log_plan(int loops, int workers) {
+    if (!m_enable) {
+        LOG_INFO("%s", "cpu affinity: disabled");
+        return;
+    }
+    for (size_t i = 0; i < m_groups.size(); ++i) {
+        const cpu_group &g = m_groups[i];
+        std::vector<int> ids;
+        for (int w = 0; w < workers; ++w) {
+            if (worker_group(w) == (int)i)
+                ids.push_back(w);
+        }
+        LOG_INFO("cpu affinity: node %d loop cpus %s, workers %s on cpus %s",
+                 g.node, format_cpulist(g.loop).c_str(),
+                 format_cpulist(ids).c_str(), format_cpulist(g.worker).c_str());
+    }
+    for (int i = 0; i < loops; ++i) {
+        LOG_INFO("cpu affinity: loop %d -> cpu %d (node %d)", i, loop_cpu(i),
+                 m_groups[loop_group(i)].node);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <string>
+#include <vector>
+
+// 按节点分开的空闲链表等最多区分的节点数，更多的节点折叠到这些链表上
+static const int CPU_MAX_NODES = 8;
+
+// 事件循环和工作线程的CPU绑定
+// 启动时从sysfs读取NUMA拓扑，与进程允许的CPU取交集后分组；
+// 事件循环按节点轮流绑定到单个CPU，工作线程按节点分组并绑定到该节点的一组CPU，
+// 线程池优先把请求交给与事件循环同节点的工作线程；
+// 连接槽和缓冲区按当前线程所在节点分开复用，新分配的内存由本线程首次写入，
+// 按内核默认的first-touch策略落在本节点
+class cpu_affinity {
+  public:
+    static cpu_affinity *get_instance() {
+        static cpu_affinity instance;
+        return &instance;
+    }
+
+    // enable为0时不绑定，所有线程视为同一节点；
+    // loop_cpus和worker_cpus为cpulist格式，如"0-3,8"，空串表示进程允许的全部CPU
+    void init(int enable, const char *loop_cpus, const char *worker_cpus,
+              int close_log);
+    bool enabled() const { return m_enable; }
+
+    // 参与分组的节点数，至少为1
+    int group_count() const { return m_groups.empty() ? 1 : m_groups.size(); }
+    // 第index个工作线程所属的组
+    int worker_group(int index) const;
+
+    // 在线程开始运行时调用：第index个事件循环(0为主循环)或工作线程绑定自身
+    void bind_loop(int index);
+    void bind_worker(int index);
+    // 当前线程所属的组，未绑定的线程为0
+    static int current_group();
+
+    // 记录loops个事件循环和workers个工作线程的绑定方案
+    void log_plan(int loops, int workers);
+
+  private:
+    cpu_affinity() : m_enable(false), m_close_log(0) {}
+    ~cpu_affinity() {}
+
+    struct cpu_group {
+        int node;                 // sysfs中的节点号
+        std::vector<int> loop;    // 该节点上可绑定事件循环的CPU
+        std::vector<int> worker;  // 该节点上可绑定工作线程的CPU
+    };
+
+    int loop_group(int index) const;
+    int loop_cpu(int index) const;
+    bool bind(const std::vector<int> &cpus, int group);
+
+  private:
+    bool m_enable;
+    int m_close_log;
+    std::vector<cpu_group> m_groups;
+    std::vector<int> m_loop_groups;   // 有事件循环CPU的组
+    std::vector<int> m_worker_groups; // 有工作线程CPU的组
+};
+
+#endif
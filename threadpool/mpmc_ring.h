@@ -0,0 +1,217 @@
+#ifndef MPMC_RING_H
+#define MPMC_RING_H
+
+#include <atomic>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+static const int CACHE_LINE_SIZE = 64;
+
+// 基于futex的事件计数，用于在条件不满足时休眠
+// 等待方：key = prepare_wait()，再检查一次条件，满足则cancel_wait()，否则wait(key)；
+// 通知方：修改条件后调用notify_one/notify_all，没有等待者时不进入内核
+// 被唤醒的等待方运行之前，后续的notify_one不再重复唤醒，由它醒来后处理
+class event_count {
+  public:
+    event_count() : m_epoch(0), m_waiters(0), m_signaled(false) {}
+
+    int prepare_wait() {
+        m_waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_acquire);
+    }
+    void cancel_wait() { done_wait(); }
+    // 可能提前返回，调用方需要重新检查条件
+    void wait(int key) {
+        syscall(SYS_futex, reinterpret_cast<int *>(&m_epoch),
+                FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+        done_wait();
+    }
+
+    void notify_one() { notify(1); }
+    void notify_all() { notify(INT_MAX); }
+
+  private:
+    // 醒着的等待方会重新检查条件，之后的修改需要重新唤醒
+    void done_wait() {
+        m_waiters.fetch_sub(1);
+        m_signaled.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void notify(int count) {
+        // 与prepare_wait中的栅栏配对：要么等待方看到条件已修改，要么这里看到等待者
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+        if (count == 1 && m_signaled.exchange(true))
+            return;
+        m_epoch.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<int *>(&m_epoch),
+                FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+    }
+
+  private:
+    std::atomic<int> m_epoch;
+    std::atomic<int> m_waiters;
+    std::atomic<bool> m_signaled; // 已唤醒一个等待方，它还没有醒来
+};
+
+// 有界的多生产者多消费者环形队列，入队出队不加锁、不分配内存
+// 每个槽有一个序号：等于位置时可写入，等于位置加1时可读出，
+// 生产者和消费者只在各自的位置计数器上CAS竞争，两个计数器分别占一个缓存行
+// try_push/try_pop在满/空时立即返回false；push/pop在满/空时休眠，close后返回false
+template <typename T> class mpmc_ring {
+  public:
+    // 容量向上取2的幂，至少为2
+    explicit mpmc_ring(unsigned int capacity) : m_closed(false) {
+        unsigned int size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_cells = new cell[size];
+        for (unsigned int i = 0; i < size; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        m_enqueue.store(0, std::memory_order_relaxed);
+        m_dequeue.store(0, std::memory_order_relaxed);
+    }
+    ~mpmc_ring() { delete[] m_cells; }
+
+    bool try_push(T item) { return enqueue(item); }
+
+    bool try_pop(T &item) {
+        unsigned int pos = m_dequeue.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            unsigned int seq = c->seq.load(std::memory_order_acquire);
+            int dif = (int)(seq - (pos + 1));
+            if (dif == 0) {
+                if (m_dequeue.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed))
+                    break;
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(c->data);
+        c->seq.store(pos + m_mask + 1, std::memory_order_release);
+        m_not_full.notify_one();
+        return true;
+    }
+
+    bool push(T item) {
+        bool waited = false;
+        while (!m_closed.load()) {
+            if (enqueue(item)) {
+                // 唤醒被合并时由醒来的一方接力唤醒下一个等待者
+                if (waited && size() <= m_mask)
+                    m_not_full.notify_one();
+                return true;
+            }
+            int key = m_not_full.prepare_wait();
+            if (size() <= m_mask || m_closed.load()) {
+                // 消费者已占位但尚未读完，让出CPU等它完成
+                m_not_full.cancel_wait();
+                std::this_thread::yield();
+                continue;
+            }
+            m_not_full.wait(key);
+            waited = true;
+        }
+        return false;
+    }
+
+    // close后仍先取完剩余的元素
+    bool pop(T &item) {
+        bool waited = false;
+        while (true) {
+            if (try_pop(item)) {
+                if (waited && !empty())
+                    m_not_empty.notify_one();
+                return true;
+            }
+            int key = m_not_empty.prepare_wait();
+            if (size() > 0) {
+                // 生产者已占位但尚未写完，让出CPU等它完成
+                m_not_empty.cancel_wait();
+                std::this_thread::yield();
+                continue;
+            }
+            if (m_closed.load()) {
+                m_not_empty.cancel_wait();
+                return false;
+            }
+            m_not_empty.wait(key);
+            waited = true;
+        }
+    }
+
+    // 唤醒所有等待者，之后push失败，pop取完剩余元素后失败
+    void close() {
+        m_closed.store(true);
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
+
+    // 包括已占位但尚未写完的元素，并发修改时只是近似值
+    unsigned int size() const {
+        unsigned int n = m_enqueue.load() - m_dequeue.load();
+        return (int)n < 0 ? 0 : n;
+    }
+    bool empty() const { return size() == 0; }
+    unsigned int capacity() const { return m_mask + 1; }
+
+  private:
+    mpmc_ring(const mpmc_ring &);
+    mpmc_ring &operator=(const mpmc_ring &);
+
+    struct cell {
+        std::atomic<unsigned int> seq;
+        T data;
+    };
+
+    // 写入成功时才移走item
+    bool enqueue(T &item) {
+        unsigned int pos = m_enqueue.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            unsigned int seq = c->seq.load(std::memory_order_acquire);
+            int dif = (int)(seq - pos);
+            if (dif == 0) {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed))
+                    break;
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = std::move(item);
+        c->seq.store(pos + 1, std::memory_order_release);
+        m_not_empty.notify_one();
+        return true;
+    }
+
+  private:
+    cell *m_cells;
+    unsigned int m_mask;
+    char m_pad0[CACHE_LINE_SIZE];
+    std::atomic<unsigned int> m_enqueue; // 下一个写入的位置
+    char m_pad1[CACHE_LINE_SIZE];
+    std::atomic<unsigned int> m_dequeue; // 下一个读出的位置
+    char m_pad2[CACHE_LINE_SIZE];
+    std::atomic<bool> m_closed;
+    event_count m_not_empty;
+    event_count m_not_full;
+};
+
+#endif
@@ -2,127 +2,545 @@
 #define THREADPOOL_H
 
 #include "../database/sql_connection_pool.h"
+#include "cpu_affinity.h"
+#include "mpmc_ring.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <exception>
-#include <list>
 #include <mutex>
 #include <thread>
+#include <time.h>
+#include <vector>
 
+// 线程数自适应的采样周期和阈值
+static const int POOL_ADAPT_INTERVAL_MS = 1000;
+static const long POOL_GROW_WAIT_US = 1000; // 平均排队超过该值视为线程不够
+static const int POOL_BLOCKED_PCT = 25; // 忙碌时间中阻塞在数据库上的比例达到该值时，加线程能利用空闲的CPU
+static const int POOL_TARGET_BUSY_PCT = 50; // 缩容后线程忙碌时间占比的目标
+static const int POOL_CALM_ROUNDS = 5;      // 连续空闲的周期数达到该值才缩容
+
+static inline long long pool_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 每个工作线程有自己的有界无锁环形队列和事件计数：
+// 提交方轮流投递到各队列，入队不加锁、不分配内存；
+// 线程自己的队列为空时从其他队列窃取，仍没有任务时在自己的事件计数上休眠，
+// 入队只唤醒一个线程，不会惊群
+// 启用CPU绑定时工作线程按NUMA节点分组，投递、窃取和唤醒都先在提交方所在的组内进行
+// 线程数可在[min_threads, max_threads]之间自适应：管理线程每个周期统计排队时间、
+// 线程忙碌时间和其中阻塞在数据库上的时间，排队变长且线程在空等数据库或还有空闲CPU时扩容，
+// 连续空闲时缩容；编号不小于当前线程数的线程处理完自己队列中的任务后退出
+// 设置了数据库通道时本池作为静态通道，线程不取数据库连接，
+// 请求解析到需要数据库的路由时转交数据库通道，静态请求不会排在等连接的请求后面
 template <typename T> class threadpool {
   public:
     /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
+    /*min_threads和max_threads为自适应的范围，为0时取thread_number，二者相等时线程数固定*/
     threadpool(int actor_model, connection_pool *connPool,
-               int thread_number = 8, int max_request = 10000);
+               int thread_number = 8, int max_request = 10000,
+               int min_threads = 0, int max_threads = 0, int close_log = 0);
     ~threadpool();
     bool append(T *request, int state);
     bool append_p(T *request);
+    // 设置数据库通道，其线程持有数据库连接；在开始处理请求前调用
+    void set_db_lane(threadpool *lane) { m_db_lane = lane; }
+
+    struct stats {
+        int threads; // 当前线程数
+        int min_threads;
+        int max_threads;
+        long tasks;   // 处理完的请求数
+        long queued;  // 队列中等待的请求数
+        long grows;   // 扩容次数
+        long shrinks; // 缩容次数
+        // 最近一个采样周期的统计和决策
+        long wait_us;         // 平均排队时间
+        int busy_pct;         // 线程忙碌时间占比
+        int blocked_pct;      // 忙碌时间中阻塞在数据库上的占比
+        const char *decision; // grow、shrink或hold
+    };
+    void get_stats(stats &s);
+    void log_stats(const char *name);
 
   private:
+    struct task {
+        T *request;
+        long long queued; // 入队时刻(ns)
+    };
+
+    struct work_queue {
+        mpmc_ring<task> *ring; // 所属线程和窃取的线程都从这里出队
+        event_count event;     // 所属线程在此休眠
+        std::atomic<bool> parked; // 线程已登记空闲，唤醒方用exchange认领
+        bool alive;               // 线程在运行，由m_resize_mutex保护
+        // 只由所属线程累加，管理线程读取
+        std::atomic<long long> tasks;
+        std::atomic<long long> wait_ns;    // 排队时间
+        std::atomic<long long> busy_ns;    // 处理请求的时间
+        std::atomic<long long> blocked_ns; // 其中阻塞在数据库上的时间
+        char pad[CACHE_LINE_SIZE]; // 相邻线程的休眠状态不落在同一缓存行
+    };
+
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
-    static void *worker(void *arg);
-    void run();
+    static void worker(threadpool *pool, int index);
+    void run(int index);
+    bool push(T *request);
+    bool push_to(int index, const task &t);
+    bool steal(int index, task &t);
+    bool park(int index);
+    void wake_idle(int from);
+    bool retire(int index);
+    void handle(T *request);
+    bool process(T *request);
+    void manage();
+    void resize(int threads);
 
   private:
-    int m_thread_number;        // 线程池中的线程数
-    int m_max_requests;         // 请求队列中允许的最大请求数
-    std::thread *m_threads;     // 描述线程池的数组，其大小为m_thread_number
-    std::list<T *> m_workqueue; // 请求队列
-    std::mutex m_queuelocker;   // 保护请求队列的互斥锁
-    std::condition_variable m_queuestat; // 是否有任务需要处理
-    connection_pool *m_connPool;         // 数据库
-    int m_actor_model;                   // 模型切换
-    bool m_stop;                         // 是否停止线程池
+    int m_thread_number;    // 线程池中的线程数上限，即max_threads
+    int m_min_threads;      // 自适应时的线程数下限
+    int m_max_requests;     // 请求队列中允许的最大请求数
+    std::thread *m_threads; // 描述线程池的数组，其大小为m_thread_number
+    work_queue *m_queues;   // 每个线程一个请求队列
+    std::vector<std::vector<int>> m_groups; // 每个节点的工作线程
+    std::vector<std::vector<int>> m_peers;  // 每个线程窃取和唤醒的顺序，同组在前
+    std::atomic<int> m_active;   // 当前线程数，编号小于它的线程接收任务
+    std::atomic<int> m_idle;     // 已登记空闲、准备休眠或正在休眠的线程数
+    connection_pool *m_connPool; // 数据库
+    threadpool *m_db_lane;       // 数据库通道，NULL表示本池的线程自己持有连接
+    int m_actor_model;           // 模型切换
+    std::atomic<bool> m_stop;    // 是否停止线程池
+    std::thread m_manager;       // 自适应线程数的管理线程
+    std::mutex m_resize_mutex;   // 保护线程的启停和统计
+    std::condition_variable m_manager_cond;
+    stats m_stats;
+    int m_calm_rounds; // 连续空闲的周期数
+    int m_close_log;
 };
 
 template <typename T>
 threadpool<T>::threadpool(int actor_model, connection_pool *connPool,
-                          int thread_number, int max_requests)
-    : m_actor_model(actor_model), m_thread_number(thread_number),
-      m_max_requests(max_requests), m_threads(nullptr), m_connPool(connPool),
-      m_stop(false) {
-    if (thread_number <= 0 || max_requests <= 0)
-        throw std::exception();
-    m_threads = new std::thread[m_thread_number];
-    if (!m_threads)
+                          int thread_number, int max_requests, int min_threads,
+                          int max_threads, int close_log)
+    : m_max_requests(max_requests), m_threads(nullptr), m_queues(nullptr),
+      m_active(0), m_idle(0), m_connPool(connPool), m_db_lane(NULL),
+      m_actor_model(actor_model), m_stop(false), m_calm_rounds(0),
+      m_close_log(close_log) {
+    if (min_threads <= 0)
+        min_threads = thread_number;
+    if (max_threads <= 0)
+        max_threads = thread_number;
+    if (thread_number <= 0 || max_requests <= 0 || min_threads <= 0 ||
+        max_threads < min_threads)
         throw std::exception();
-    for (int i = 0; i < thread_number; ++i) {
-        m_threads[i] = std::thread(worker, this);
+    if (thread_number < min_threads)
+        thread_number = min_threads;
+    if (thread_number > max_threads)
+        thread_number = max_threads;
+    m_thread_number = max_threads;
+    m_min_threads = min_threads;
+    // 每个队列的容量取2的幂，按线程数下限计算：缩容后只有在编线程的队列接收任务，
+    // 线程数最少时这些队列的总容量仍不小于max_requests
+    unsigned int cap = 1;
+    while ((long)cap * m_min_threads < max_requests)
+        cap <<= 1;
+    m_queues = new work_queue[m_thread_number];
+    for (int i = 0; i < m_thread_number; ++i) {
+        m_queues[i].ring = new mpmc_ring<task>(cap);
+        m_queues[i].parked = false;
+        m_queues[i].alive = false;
+        m_queues[i].tasks = 0;
+        m_queues[i].wait_ns = 0;
+        m_queues[i].busy_ns = 0;
+        m_queues[i].blocked_ns = 0;
+    }
+    cpu_affinity *affinity = cpu_affinity::get_instance();
+    m_groups.resize(affinity->group_count());
+    for (int i = 0; i < m_thread_number; ++i)
+        m_groups[affinity->worker_group(i)].push_back(i);
+    m_peers.resize(m_thread_number);
+    for (int i = 0; i < m_thread_number; ++i) {
+        int group = affinity->worker_group(i);
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int j = 1; j < m_thread_number; ++j) {
+                int peer = (i + j) % m_thread_number;
+                if ((affinity->worker_group(peer) == group) == (pass == 0))
+                    m_peers[i].push_back(peer);
+            }
+        }
     }
+
+    m_stats.threads = thread_number;
+    m_stats.min_threads = m_min_threads;
+    m_stats.max_threads = m_thread_number;
+    m_stats.tasks = 0;
+    m_stats.grows = 0;
+    m_stats.shrinks = 0;
+    m_stats.queued = 0;
+    m_stats.wait_us = 0;
+    m_stats.busy_pct = 0;
+    m_stats.blocked_pct = 0;
+    m_stats.decision = "hold";
+
+    m_threads = new std::thread[m_thread_number];
+    resize(thread_number);
+    if (m_thread_number > m_min_threads)
+        m_manager = std::thread(&threadpool::manage, this);
 }
 
 template <typename T> threadpool<T>::~threadpool() {
-    m_stop = true;
-    m_queuestat.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(m_resize_mutex);
+        m_stop = true;
+    }
+    m_manager_cond.notify_all();
+    if (m_manager.joinable())
+        m_manager.join();
+    for (int i = 0; i < m_thread_number; ++i)
+        m_queues[i].event.notify_all();
     for (int i = 0; i < m_thread_number; ++i) {
         if (m_threads[i].joinable()) {
             m_threads[i].join();
         }
     }
     delete[] m_threads;
+    for (int i = 0; i < m_thread_number; ++i)
+        delete m_queues[i].ring;
+    delete[] m_queues;
 }
 
+// 事件循环投递请求，处理完毕前连接不会被关闭；队列已满时放弃本次处理
 template <typename T> bool threadpool<T>::append(T *request, int state) {
-    std::unique_lock<std::mutex> lock(m_queuelocker);
-    if (m_workqueue.size() >= m_max_requests) {
-        return false;
-    }
     request->m_state = state;
-    m_workqueue.push_back(request);
-    m_queuestat.notify_one();
-    return true;
+    return append_p(request);
 }
 
 template <typename T> bool threadpool<T>::append_p(T *request) {
-    std::unique_lock<std::mutex> lock(m_queuelocker);
-    if (m_workqueue.size() >= m_max_requests) {
+    request->start_task();
+    if (push(request))
+        return true;
+    request->finish_task();
+    return false;
+}
+
+// 先在提交线程所在节点的组内、从其轮转位置开始找一个未满的队列，
+// 组内都满时再找其他线程，所有队列都满时返回false；只投递给当前在编的线程
+template <typename T> bool threadpool<T>::push(T *request) {
+    // 每个事件循环线程各自轮转，不共享计数器
+    static thread_local unsigned int next = 0;
+    unsigned int start = next++;
+    task t;
+    t.request = request;
+    t.queued = pool_now_ns();
+    int active = m_active.load(std::memory_order_relaxed);
+    if (m_groups.size() > 1) {
+        const std::vector<int> &local =
+            m_groups[cpu_affinity::current_group() % m_groups.size()];
+        for (size_t i = 0; i < local.size(); ++i) {
+            int index = local[(start + i) % local.size()];
+            if (index < active && push_to(index, t))
+                return true;
+        }
+    }
+    for (int i = 0; i < active; ++i) {
+        if (push_to((start + i) % active, t))
+            return true;
+    }
+    return false;
+}
+
+template <typename T> bool threadpool<T>::push_to(int index, const task &t) {
+    work_queue &q = m_queues[index];
+    if (!q.ring->try_push(t))
         return false;
+    // 入队与读取休眠状态之间的栅栏和park中的配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (q.parked.load(std::memory_order_relaxed) && q.parked.exchange(false))
+        q.event.notify_one();
+    else if (m_idle.load() > 0)
+        wake_idle(index);
+    return true;
+}
+
+// 从其他线程的队列窃取一个任务，取最早入队的，保持先到先处理
+// 已退出的线程队列中遗留的任务也由此取走
+template <typename T> bool threadpool<T>::steal(int index, task &t) {
+    const std::vector<int> &peers = m_peers[index];
+    for (size_t i = 0; i < peers.size(); ++i) {
+        if (m_queues[peers[i]].ring->try_pop(t))
+            return true;
+    }
+    return false;
+}
+
+// 没有任务时休眠，返回false表示线程池已停止且没有剩余任务
+template <typename T> bool threadpool<T>::park(int index) {
+    work_queue &q = m_queues[index];
+    int key = q.event.prepare_wait();
+    q.parked.store(true);
+    m_idle.fetch_add(1);
+    // 先登记空闲再检查所有队列：提交方先入队再读休眠状态，
+    // 二者之间都有seq_cst栅栏，至少有一方能看到对方，任务不会滞留在忙碌线程的队列中
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool found = false;
+    for (int i = 0; i < m_thread_number && !found; ++i)
+        found = !m_queues[i].ring->empty();
+    bool stop = !found && m_stop;
+    // 认领了本线程的唤醒方随后会notify，parked被清除之前不会错过；
+    // 因停止或缩容被唤醒时返回true，回到run中处理
+    if (!found && !stop) {
+        while (q.parked.load() && !m_stop) {
+            q.event.wait(key);
+            key = q.event.prepare_wait();
+        }
+    }
+    q.event.cancel_wait();
+    q.parked.store(false);
+    m_idle.fetch_sub(1);
+    return !stop;
+}
+
+// 任务投递给了忙碌的线程，唤醒一个休眠的线程来窃取
+template <typename T> void threadpool<T>::wake_idle(int from) {
+    const std::vector<int> &peers = m_peers[from];
+    for (size_t i = 0; i < peers.size(); ++i) {
+        if (peers[i] >= m_active.load(std::memory_order_relaxed))
+            continue;
+        work_queue &q = m_queues[peers[i]];
+        if (q.parked.load(std::memory_order_relaxed) &&
+            q.parked.exchange(false)) {
+            q.event.notify_one();
+            return;
+        }
     }
-    m_workqueue.push_back(request);
-    m_queuestat.notify_one();
+}
+
+// 被缩容的线程在自己的队列取空后退出；期间又扩容回来时继续运行
+// 退出后才入队的任务由其他线程窃取
+template <typename T> bool threadpool<T>::retire(int index) {
+    std::unique_lock<std::mutex> lock(m_resize_mutex);
+    if (index < m_active.load() || !m_queues[index].ring->empty())
+        return false;
+    m_queues[index].alive = false;
     return true;
 }
 
-template <typename T> void *threadpool<T>::worker(void *arg) {
-    threadpool *pool = (threadpool *)arg;
-    pool->run();
-    return pool;
+template <typename T> void threadpool<T>::worker(threadpool *pool, int index) {
+    pool->run(index);
 }
 
-template <typename T> void threadpool<T>::run() {
+template <typename T> void threadpool<T>::run(int index) {
+    cpu_affinity::get_instance()->bind_worker(index);
+    work_queue &q = m_queues[index];
     while (true) {
-        std::unique_lock<std::mutex> lock(m_queuelocker);
-        m_queuestat.wait(lock,
-                         [this]() { return !m_workqueue.empty() || m_stop; });
-        if (m_stop && m_workqueue.empty()) {
-            break;
+        task t;
+        bool retiring = index >= m_active.load(std::memory_order_relaxed);
+        if (!q.ring->try_pop(t) && (retiring || !steal(index, t))) {
+            if (retiring) {
+                if (retire(index))
+                    break;
+                continue;
+            }
+            // 停止时先处理完所有队列中剩余的任务
+            if (!park(index))
+                break;
+            continue;
+        }
+        long long start = pool_now_ns();
+        handle(t.request);
+        long long end = pool_now_ns();
+        q.tasks.fetch_add(1, std::memory_order_relaxed);
+        q.wait_ns.fetch_add(start - t.queued, std::memory_order_relaxed);
+        q.busy_ns.fetch_add(end - start, std::memory_order_relaxed);
+        q.blocked_ns.fetch_add(sqlWaitRAII::take(), std::memory_order_relaxed);
+    }
+}
+
+// 处理完毕后归还连接，转交数据库通道的由数据库通道处理完毕后归还
+template <typename T> void threadpool<T>::handle(T *request) {
+    // 从静态通道转来的请求已读完，直接继续process
+    if (m_actor_model == 1 && !request->db_pending()) {
+        if (request->m_state == 0) {
+            if (!request->read_once()) {
+                // 需要关闭连接时通知所属事件循环，由其清理定时器
+                request->timer_flag = 1;
+                request->notify_close();
+            } else if (!process(request)) {
+                return;
+            }
+        } else {
+            bool more;
+            if (!request->write(more)) {
+                request->timer_flag = 1;
+                request->notify_close();
+            } else if (more && !process(request)) {
+                // 响应发完后读缓冲区中还有流水线的后续请求
+                return;
+            }
         }
-        T *request = m_workqueue.front();
-        m_workqueue.pop_front();
-        if (!request) {
+    } else if (!process(request)) {
+        return;
+    }
+    request->finish_task();
+}
+
+// 请求转交数据库通道时返回false，之后不能再访问request
+// 数据库通道的队列已满时就地取连接处理
+template <typename T> bool threadpool<T>::process(T *request) {
+    if (m_db_lane) {
+        request->mysql = NULL;
+        if (request->process())
+            return true;
+        if (m_db_lane->push(request))
+            return false;
+    }
+    connectionRAII mysqlcon(&request->mysql, m_connPool);
+    request->process();
+    return true;
+}
+
+// 调用方持有m_resize_mutex或线程池尚未启动
+// 扩容时启动新线程，编号上的旧线程已退出的先回收；缩容时唤醒休眠中要退出的线程
+template <typename T> void threadpool<T>::resize(int threads) {
+    int old = m_active.load();
+    m_active.store(threads);
+    for (int i = threads; i < old; ++i) {
+        work_queue &q = m_queues[i];
+        if (q.parked.load() && q.parked.exchange(false))
+            q.event.notify_one();
+    }
+    for (int i = old; i < threads; ++i) {
+        if (m_queues[i].alive)
             continue;
+        if (m_threads[i].joinable())
+            m_threads[i].join();
+        m_queues[i].alive = true;
+        m_threads[i] = std::thread(worker, this, i);
+    }
+    m_stats.threads = threads;
+}
+
+// 每个周期根据上一周期的统计决定线程数：
+// 平均排队超过POOL_GROW_WAIT_US或排队的请求多于线程数时，若线程多在阻塞等数据库，
+// 按CPU时间占比把线程数放大到能占满原有的CPU时间(最多翻倍)，否则还有空闲CPU时加一个；
+// 没有排队且忙碌占比低于POOL_TARGET_BUSY_PCT持续POOL_CALM_ROUNDS个周期后，
+// 每个周期把线程数向达到该占比所需的线程数减少一半
+template <typename T> void threadpool<T>::manage() {
+    long long last_tasks = 0, last_wait = 0, last_busy = 0, last_blocked = 0;
+    long long last = pool_now_ns();
+    int cpus = std::thread::hardware_concurrency();
+    if (cpus <= 0)
+        cpus = 1;
+    std::unique_lock<std::mutex> lock(m_resize_mutex);
+    while (!m_stop) {
+        m_manager_cond.wait_for(
+            lock, std::chrono::milliseconds(POOL_ADAPT_INTERVAL_MS));
+        if (m_stop)
+            break;
+
+        long long tasks = 0, wait = 0, busy = 0, blocked = 0, queued = 0;
+        for (int i = 0; i < m_thread_number; ++i) {
+            work_queue &q = m_queues[i];
+            tasks += q.tasks.load(std::memory_order_relaxed);
+            wait += q.wait_ns.load(std::memory_order_relaxed);
+            busy += q.busy_ns.load(std::memory_order_relaxed);
+            blocked += q.blocked_ns.load(std::memory_order_relaxed);
+            queued += q.ring->size();
         }
-        if (m_actor_model == 1) {
-            if (request->m_state == 0) {
-                if (request->read_once()) {
-                    request->improv = 1;
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
-                    request->process();
-                } else {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
-            } else {
-                if (request->write()) {
-                    request->improv = 1;
-                } else {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+        long long now = pool_now_ns();
+        long long d_tasks = tasks - last_tasks;
+        long long d_wait = wait - last_wait;
+        long long d_busy = busy - last_busy;
+        long long d_blocked = blocked - last_blocked;
+        long long elapsed = now - last;
+        last_tasks = tasks;
+        last_wait = wait;
+        last_busy = busy;
+        last_blocked = blocked;
+        last = now;
+
+        int active = m_active.load();
+        long wait_us = d_tasks ? d_wait / d_tasks / 1000 : 0;
+        int busy_pct = elapsed > 0 ? d_busy * 100 / (elapsed * active) : 0;
+        if (busy_pct > 100)
+            busy_pct = 100;
+        int blocked_pct = d_busy ? d_blocked * 100 / d_busy : 0;
+        // 有排队却没有请求处理完，线程都卡在长时间的阻塞中
+        if (d_tasks == 0 && queued > 0)
+            blocked_pct = 100;
+
+        int target = active;
+        const char *decision = "hold";
+        if (wait_us >= POOL_GROW_WAIT_US || queued > active) {
+            m_calm_rounds = 0;
+            if (blocked_pct >= POOL_BLOCKED_PCT) {
+                target = blocked_pct >= 50 ? active * 2
+                                           : active * 100 / (100 - blocked_pct);
+                if (target <= active)
+                    target = active + 1;
+            } else if (busy_pct * active / 100 < cpus) {
+                target = active + 1;
+            }
+            if (target > m_thread_number)
+                target = m_thread_number;
+        } else if (queued == 0 && busy_pct < POOL_TARGET_BUSY_PCT) {
+            if (++m_calm_rounds >= POOL_CALM_ROUNDS) {
+                int need = (busy_pct * active + POOL_TARGET_BUSY_PCT - 1) /
+                           POOL_TARGET_BUSY_PCT;
+                if (need < m_min_threads)
+                    need = m_min_threads;
+                int step = (active - need) / 2;
+                target = active - (step > 0 ? step : 1);
+                if (target < m_min_threads)
+                    target = m_min_threads;
             }
         } else {
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
-            request->process();
+            m_calm_rounds = 0;
+        }
+
+        if (target > active) {
+            decision = "grow";
+            ++m_stats.grows;
+        } else if (target < active) {
+            decision = "shrink";
+            ++m_stats.shrinks;
+        }
+        m_stats.wait_us = wait_us;
+        m_stats.busy_pct = busy_pct;
+        m_stats.blocked_pct = blocked_pct;
+        m_stats.decision = decision;
+        if (target != active) {
+            LOG_INFO("threadpool: %s %d -> %d threads (wait %ldus, queued "
+                     "%lld, busy %d%%, blocked %d%%)",
+                     decision, active, target, wait_us, queued, busy_pct,
+                     blocked_pct);
+            resize(target);
         }
     }
 }
+
+template <typename T> void threadpool<T>::get_stats(stats &s) {
+    std::unique_lock<std::mutex> lock(m_resize_mutex);
+    s = m_stats;
+    s.tasks = 0;
+    s.queued = 0;
+    for (int i = 0; i < m_thread_number; ++i) {
+        s.tasks += m_queues[i].tasks.load(std::memory_order_relaxed);
+        s.queued += m_queues[i].ring->size();
+    }
+}
+
+template <typename T> void threadpool<T>::log_stats(const char *name) {
+    stats s;
+    get_stats(s);
+    LOG_INFO("%s: threads %d [%d, %d], tasks %ld, queued %ld, grows "
+             "%ld, shrinks %ld, last %s (wait %ldus, busy %d%%, blocked %d%%)",
+             name, s.threads, s.min_threads, s.max_threads, s.tasks, s.queued,
+             s.grows, s.shrinks, s.decision, s.wait_us, s.busy_pct,
+             s.blocked_pct);
+}
 #endif
@@ -1,124 +1,191 @@
 #include "lst_timer.h"
+#include "../http/conn_table.h"
 #include "../http/http_conn.h"
 
-sort_timer_lst::sort_timer_lst() {
-    head = NULL;
-    tail = NULL;
+time_wheel::time_wheel() : m_cur(monotonic_ms()), m_count(0) {
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_used, 0, sizeof(m_used));
 }
-sort_timer_lst::~sort_timer_lst() {
-    util_timer *tmp = head;
-    while (tmp) {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
+
+time_wheel::~time_wheel() {
+    for (int i = 0; i < WHEEL_LEVELS * WHEEL_SIZE; ++i) {
+        util_timer *tmp = m_slots[i];
+        while (tmp) {
+            m_slots[i] = tmp->next;
+            delete tmp;
+            tmp = m_slots[i];
+        }
     }
 }
 
-void sort_timer_lst::add_timer(util_timer *timer) {
+void time_wheel::add_timer(util_timer *timer) {
     if (!timer) {
         return;
     }
-    if (!head) {
-        head = tail = timer;
-        return;
-    }
-    if (timer->expire < head->expire) {
-        timer->next = head;
-        head->prev = timer;
-        head = timer;
-        return;
-    }
-    add_timer(timer, head);
+    insert(timer);
+    m_count++;
 }
-void sort_timer_lst::adjust_timer(util_timer *timer) {
+
+// expire已被更新，从原槽位摘下后按新的到期时间重新放入
+void time_wheel::adjust_timer(util_timer *timer) {
     if (!timer) {
         return;
     }
-    util_timer *tmp = timer->next;
-    if (!tmp || (timer->expire < tmp->expire)) {
-        return;
-    }
-    if (timer == head) {
-        head = head->next;
-        head->prev = NULL;
-        timer->next = NULL;
-        add_timer(timer, head);
-    } else {
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        add_timer(timer, timer->next);
-    }
+    unlink(timer);
+    insert(timer);
 }
-void sort_timer_lst::del_timer(util_timer *timer) {
+
+void time_wheel::del_timer(util_timer *timer) {
     if (!timer) {
         return;
     }
-    if ((timer == head) && (timer == tail)) {
-        delete timer;
-        head = NULL;
-        tail = NULL;
-        return;
+    unlink(timer);
+    m_count--;
+    delete timer;
+}
+
+// 处理到当前时刻为止需要处理的时刻，中间的空槽直接跳过
+// 第0层每跨过一圈就把高层对应槽下放
+void time_wheel::tick() {
+    time_t cur = monotonic_ms();
+    while (true) {
+        time_t due = next_expire();
+        if (due < 0 || due > cur) {
+            if (m_cur <= cur) {
+                m_cur = cur + 1;
+            }
+            return;
+        }
+        m_cur = due;
+
+        int idx = m_cur & WHEEL_MASK;
+        if (0 == idx) {
+            for (int level = 1; level < WHEEL_LEVELS; ++level) {
+                int i = (m_cur >> (level * WHEEL_BITS)) & WHEEL_MASK;
+                cascade(level, i);
+                if (i != 0) {
+                    break;
+                }
+            }
+        }
+
+        util_timer *tmp = m_slots[idx];
+        m_slots[idx] = NULL;
+        mark_empty(idx);
+        m_cur++;
+        while (tmp) {
+            util_timer *next = tmp->next;
+            tmp->cb_func(tmp->user_data);
+            m_count--;
+            delete tmp;
+            tmp = next;
+        }
     }
-    if (timer == head) {
-        head = head->next;
-        head->prev = NULL;
-        delete timer;
-        return;
+}
+
+// 位图循环右移到当前位置后取最低的置位，即按时间顺序最近的非空槽
+// 高层当前位置的槽在m_cur对齐到该层槽边界时尚未下放，否则其中是绕回的下一圈定时器
+time_t time_wheel::next_expire() {
+    if (0 == m_count) {
+        return -1;
     }
-    if (timer == tail) {
-        tail = tail->prev;
-        tail->next = NULL;
-        delete timer;
-        return;
+    time_t best = -1;
+    for (int level = 0; level < WHEEL_LEVELS; ++level) {
+        uint64_t used = m_used[level];
+        if (!used) {
+            continue;
+        }
+        int shift = level * WHEEL_BITS;
+        time_t pos = m_cur >> shift;
+        int first = level > 0 && (m_cur & (((time_t)1 << shift) - 1)) ? 1 : 0;
+        int rot = (pos + first) & WHEEL_MASK;
+        uint64_t ring = rot ? (used >> rot) | (used << (WHEEL_SIZE - rot)) : used;
+        time_t t = (pos + first + __builtin_ctzll(ring)) << shift;
+        if (best < 0 || t < best) {
+            best = t;
+        }
     }
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
+    return best;
 }
-void sort_timer_lst::tick() {
-    if (!head) {
-        return;
-    }
 
-    time_t cur = time(NULL);
-    util_timer *tmp = head;
-    while (tmp) {
-        if (cur < tmp->expire) {
-            break;
+// 按距离当前时刻的远近选择层级，超出最高层范围的按最高层上限处理
+void time_wheel::insert(util_timer *timer) {
+    time_t expire = timer->expire;
+    time_t delta = expire - m_cur;
+    int level, idx;
+    if (delta < 0) {
+        level = 0;
+        idx = m_cur & WHEEL_MASK;
+    } else {
+        const time_t max_delta = ((time_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+        if (delta > max_delta) {
+            expire = m_cur + max_delta;
+            delta = max_delta;
         }
-        tmp->cb_func(tmp->user_data);
-        head = tmp->next;
-        if (head) {
-            head->prev = NULL;
+        level = 0;
+        while (level < WHEEL_LEVELS - 1 &&
+               delta >= ((time_t)1 << ((level + 1) * WHEEL_BITS))) {
+            level++;
         }
-        delete tmp;
-        tmp = head;
+        idx = (expire >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    }
+
+    int slot = level * WHEEL_SIZE + idx;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = m_slots[slot];
+    if (m_slots[slot]) {
+        m_slots[slot]->prev = timer;
     }
+    m_slots[slot] = timer;
+    m_used[level] |= (uint64_t)1 << idx;
 }
 
-void sort_timer_lst::add_timer(util_timer *timer, util_timer *lst_head) {
-    util_timer *prev = lst_head;
-    util_timer *tmp = prev->next;
-    while (tmp) {
-        if (timer->expire < tmp->expire) {
-            prev->next = timer;
-            timer->next = tmp;
-            tmp->prev = timer;
-            timer->prev = prev;
-            break;
+void time_wheel::unlink(util_timer *timer) {
+    if (timer->slot < 0) {
+        return;
+    }
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        m_slots[timer->slot] = timer->next;
+        if (!timer->next) {
+            mark_empty(timer->slot);
         }
-        prev = tmp;
-        tmp = tmp->next;
     }
-    if (!tmp) {
-        prev->next = timer;
-        timer->prev = prev;
-        timer->next = NULL;
-        tail = timer;
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = timer->next = NULL;
+    timer->slot = -1;
+}
+
+void time_wheel::cascade(int level, int idx) {
+    int slot = level * WHEEL_SIZE + idx;
+    util_timer *tmp = m_slots[slot];
+    m_slots[slot] = NULL;
+    mark_empty(slot);
+    while (tmp) {
+        util_timer *next = tmp->next;
+        insert(tmp);
+        tmp = next;
     }
 }
 
-void Utils::init(int timeslot) { m_TIMESLOT = timeslot; }
+void time_wheel::mark_empty(int slot) {
+    m_used[slot / WHEEL_SIZE] &= ~((uint64_t)1 << (slot & WHEEL_MASK));
+}
+
+time_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (time_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool Utils::init() {
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    return m_timerfd != -1;
+}
 
 // 对文件描述符设置非阻塞
 int Utils::setnonblocking(int fd) {
@@ -129,6 +196,7 @@ int Utils::setnonblocking(int fd) {
 }
 
 // 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
+// fd在创建时已设为非阻塞(accept4/SOCK_NONBLOCK等)，这里不再fcntl
 void Utils::addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
     epoll_event event;
     event.data.fd = fd;
@@ -141,16 +209,6 @@ void Utils::addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
     if (one_shot)
         event.events |= EPOLLONESHOT;
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setnonblocking(fd);
-}
-
-// 信号处理函数
-void Utils::sig_handler(int sig) {
-    // 为保证函数的可重入性，保留原来的errno
-    int save_errno = errno;
-    int msg = sig;
-    send(u_pipefd[1], (char *)&msg, 1, 0);
-    errno = save_errno;
 }
 
 // 设置信号函数
@@ -164,24 +222,59 @@ void Utils::addsig(int sig, void(handler)(int), bool restart) {
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-// 定时处理任务，重新定时以不断触发SIGALRM信号
+// 定时处理任务，timerfd到期后处理到期定时器并重新设置timerfd
 void Utils::timer_handler() {
+    uint64_t expirations;
+    while (read(m_timerfd, &expirations, sizeof(expirations)) > 0) {
+    }
+    m_timer_armed = -1;
     m_timer_lst.tick();
-    alarm(m_TIMESLOT);
+    rearm_timer();
 }
 
+// 按最近的到期时间设置timerfd，只有需要提前唤醒时才重新设置
+void Utils::rearm_timer() {
+    time_t next = m_timer_lst.next_expire();
+    if (next < 0 || (m_timer_armed != -1 && m_timer_armed <= next)) {
+        return;
+    }
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    // 绝对时间为0表示停止计时，这里至少设为1纳秒
+    if (0 == next) {
+        its.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+    m_timer_armed = next;
+}
+
+// 新连接是非阻塞的，发送失败也不重试，不会阻塞事件循环
 void Utils::show_error(int connfd, const char *info) {
-    send(connfd, info, strlen(info), 0);
+    send(connfd, info, strlen(info), MSG_DONTWAIT | MSG_NOSIGNAL);
     close(connfd);
 }
 
-int *Utils::u_pipefd = 0;
-int Utils::u_epollfd = 0;
-
 class Utils;
+// 关闭连接的唯一入口，只在所属事件循环中调用
+// 工作线程仍持有连接时只清空定时器，等最后一个任务结束后经completion_queue回报，
+// 事件循环再次调用时才真正关闭，连接槽和缓冲区不会在处理过程中被回收
 void cb_func(client_data *user_data) {
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
-    close(user_data->sockfd);
+    user_data->timer = NULL;
+    conn_slot *slot = user_data->conns->get(user_data->sockfd);
+    if (slot && !slot->conn.try_close())
+        return;
+    // 先归还连接槽再关闭fd：fd关闭后可能立即被其他线程accept复用，
+    // 此时再按fd归还会把新连接的槽释放掉；归还后user_data也可能被复用，不能再访问
+    int sockfd = user_data->sockfd;
+    epoll_ctl(user_data->epollfd, EPOLL_CTL_DEL, sockfd, 0);
+    user_data->conns->release(sockfd);
+    // io_uring模式下未完成的recv/sendmsg仍持有套接字，仅close不会断开连接；
+    // shutdown使其立即以错误完成，过期的完成事件由代数检查丢弃
+    shutdown(sockfd, SHUT_RDWR);
+    close(sockfd);
     http_conn::m_user_count--;
 }
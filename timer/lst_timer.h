@@ -9,6 +9,7 @@
 #include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,7 @@
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/wait.h>
@@ -25,16 +27,20 @@
 #include <time.h>
 
 class util_timer;
+class conn_table;
 
 struct client_data {
     sockaddr_in address;
     int sockfd;
+    int epollfd;          // 连接所属reactor的epoll
+    unsigned int io_gen;  // 连接代数，识别过期的io_uring完成事件和工作线程回报
+    conn_table *conns;    // 所属连接表，关闭后归还连接槽
     util_timer *timer;
 };
 
 class util_timer {
   public:
-    util_timer() : prev(NULL), next(NULL) {}
+    util_timer() : prev(NULL), next(NULL), slot(-1) {}
 
   public:
     time_t expire;
@@ -43,31 +49,56 @@ class util_timer {
     client_data *user_data;
     util_timer *prev;
     util_timer *next;
+    int slot; // 所在时间轮槽位(层号*槽数+下标)，-1表示不在时间轮上
 };
 
-class sort_timer_lst {
+// 分层时间轮，以毫秒为刻度
+// 共4层，每层64个槽，第0层每槽1毫秒，第n层每槽64^n毫秒(最高约4.6小时)，
+// 远期定时器放在高层，时间推进到该槽时再逐级下放到低层
+// 每层用一个64位位图记录非空槽，空槽之间直接跳过，只在有定时器的时刻和
+// 非空高层槽的下放时刻唤醒
+// 添加、调整、删除均为O(1)，到期处理均摊O(1)
+class time_wheel {
   public:
-    sort_timer_lst();
-    ~sort_timer_lst();
+    time_wheel();
+    ~time_wheel();
 
     void add_timer(util_timer *timer);
     void adjust_timer(util_timer *timer);
     void del_timer(util_timer *timer);
     void tick();
 
-  private:
-    void add_timer(util_timer *timer, util_timer *lst_head);
+    // 下一次需要tick的时刻，没有定时器时返回-1
+    // 第0层为最近定时器的到期时刻，高层为最近非空槽的下放时刻，不晚于其中定时器的到期时刻
+    time_t next_expire();
 
-    util_timer *head;
-    util_timer *tail;
+  private:
+    void insert(util_timer *timer);
+    void unlink(util_timer *timer);
+    void cascade(int level, int idx);
+    void mark_empty(int slot);
+
+    static const int WHEEL_BITS = 6;
+    static const int WHEEL_SIZE = 1 << WHEEL_BITS;
+    static const int WHEEL_MASK = WHEEL_SIZE - 1;
+    static const int WHEEL_LEVELS = 4;
+
+    util_timer *m_slots[WHEEL_LEVELS * WHEEL_SIZE];
+    uint64_t m_used[WHEEL_LEVELS]; // 每层非空槽的位图
+    time_t m_cur; // 下一个待处理的时刻
+    int m_count;  // 轮上的定时器数量
 };
 
 class Utils {
   public:
-    Utils() {}
-    ~Utils() {}
+    Utils() : m_timerfd(-1), m_timer_armed(-1) {}
+    ~Utils() {
+        if (m_timerfd != -1)
+            close(m_timerfd);
+    }
 
-    void init(int timeslot);
+    // 创建驱动定时器的timerfd
+    bool init();
 
     // 对文件描述符设置非阻塞
     int setnonblocking(int fd);
@@ -75,24 +106,26 @@ class Utils {
     // 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
     void addfd(int epollfd, int fd, bool one_shot, int TRIGMode);
 
-    // 信号处理函数
-    static void sig_handler(int sig);
-
     // 设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    // 定时处理任务，重新定时以不断触发SIGALRM信号
+    // 定时处理任务，timerfd到期后处理到期定时器并重新设置timerfd
     void timer_handler();
 
+    // 按最近的到期时间设置timerfd，只有需要提前唤醒时才重新设置
+    void rearm_timer();
+
     void show_error(int connfd, const char *info);
 
   public:
-    static int *u_pipefd;
-    sort_timer_lst m_timer_lst;
-    static int u_epollfd;
-    int m_TIMESLOT;
+    time_wheel m_timer_lst;
+    int m_timerfd;
+    time_t m_timer_armed; // timerfd已设置的到期时刻，-1表示未设置
 };
 
+// 单调时钟的当前毫秒数，定时器的expire均以此为准
+time_t monotonic_ms();
+
 void cb_func(client_data *user_data);
 
 #endif
@@ -1,8 +1,24 @@
 #include "webserver.h"
 
+// io_uring请求的user_data：高8位为操作类型，中间24位为连接代数，低32位为fd
+// 每个新连接由连接表分配新的代数，之前提交的请求返回时据此识别为过期
+enum {
+    URING_ACCEPT = 1,
+    URING_POLL,
+    URING_RECV,
+    URING_WRITE,
+    URING_LISTEN,  // fd耗尽期间等待监听fd可读，之后恢复多发accept
+    URING_SENDFILE // 等待连接可写后由事件循环sendfile
+};
+
+static inline uint64_t uring_data(int op, unsigned int gen, int fd) {
+    return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) |
+           (uint32_t)fd;
+}
+
 WebServer::WebServer() {
-    // http_conn类对象
-    users = new http_conn[MAX_FD];
+    // 连接表，连接建立时才分配http_conn和定时器数据
+    m_conns = new conn_table(MAX_FD);
 
     // root文件夹路径
     char server_path[200];
@@ -12,35 +28,83 @@ WebServer::WebServer() {
     strcpy(m_root, server_path);
     strcat(m_root, root);
 
-    // 定时器
-    users_timer = new client_data[MAX_FD];
+    m_main_loop = new event_loop;
+    m_next_loop = 0;
+    m_idlefd = -1;
+    m_cachefd = -1;
+    m_accept_pending = false;
 }
 
 WebServer::~WebServer() {
+    stop_sub_loops();
+    // 线程池停止时先处理完剩余的请求，期间还会访问连接和事件循环，要在它们之前销毁；
+    // 静态通道停止前还可能向数据库通道转交请求
+    m_pool->log_stats("static lane");
+    m_db_pool->log_stats("db lane");
+    delete m_pool;
+    delete m_db_pool;
+    for (size_t i = 0; i < m_sub_loops.size(); ++i) {
+        close(m_sub_loops[i]->epollfd);
+        close(m_sub_loops[i]->wakefd);
+        delete m_sub_loops[i];
+    }
     close(m_epollfd);
     close(m_listenfd);
-    close(m_pipefd[1]);
-    close(m_pipefd[0]);
-    delete[] users;
-    delete[] users_timer;
-    delete m_pool;
+    close(m_signalfd);
+    close(m_idlefd);
+    file_cache::get_instance()->log_stats();
+    open_file_cache::get_instance()->log_stats();
+    delete m_main_loop;
+    delete m_conns;
 }
 
 void WebServer::init(int port, std::string user, std::string passWord,
                      std::string databaseName, int log_write, int opt_linger,
-                     int trigmode, int sql_num, int thread_num, int close_log,
-                     int actor_model) {
+                     int trigmode, int sql_num, int thread_num, int loop_num,
+                     int close_log, int actor_model, int uring_mode,
+                     int idle_timeout, int header_timeout,
+                     int keepalive_timeout, int max_body, int backlog,
+                     int cache_size, int cache_object, int fd_cache,
+                     int fd_cache_valid, int gzip_min, int affinity,
+                     std::string loop_cpus, std::string worker_cpus,
+                     int min_threads, int max_threads, int db_threads) {
     m_port = port;
     m_user = user;
     m_passWord = passWord;
     m_databaseName = databaseName;
     m_sql_num = sql_num;
     m_thread_num = thread_num;
+    m_min_threads = min_threads;
+    m_max_threads = max_threads;
+    m_db_threads = db_threads;
+    m_loop_num = loop_num;
     m_log_write = log_write;
     m_OPT_LINGER = opt_linger;
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_uring_mode = uring_mode;
+    m_idle_timeout = idle_timeout;
+    m_header_timeout = header_timeout;
+    m_keepalive_timeout = keepalive_timeout;
+    m_max_body = max_body;
+    m_backlog = backlog;
+    m_cache_size = cache_size;
+    m_cache_object = cache_object;
+    m_fd_cache = fd_cache;
+    m_fd_cache_valid = fd_cache_valid;
+    m_gzip_min = gzip_min;
+    m_affinity = affinity;
+    m_loop_cpus = loop_cpus;
+    m_worker_cpus = worker_cpus;
+
+    // 信号统一由主循环的signalfd接收，需要在创建日志、线程池等线程之前屏蔽，
+    // 这样工作线程不会再被信号打断
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
 }
 
 void WebServer::trig_mode() {
@@ -69,7 +133,12 @@ void WebServer::trig_mode() {
 void WebServer::log_write() {
     if (0 == m_close_log) {
         // 初始化日志
-        Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000);
+        if (1 == m_log_write)
+            Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000,
+                                      800);
+        else
+            Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000,
+                                      0);
     }
 }
 
@@ -80,17 +149,57 @@ void WebServer::sql_pool() {
                      m_sql_num, m_close_log);
 
     // 初始化数据库读取表
-    users->initmysql_result(m_connPool);
+    http_conn::initmysql_result(m_connPool, m_close_log);
 }
 
 void WebServer::thread_pool() {
-    // 线程池
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    // io_uring模式下读写由事件循环完成，只支持proactor
+    if (1 == m_uring_mode && 1 == m_actormodel) {
+        LOG_WARN("%s", "io_uring backend only supports proactor, actor_model "
+                       "switched to 0");
+        m_actormodel = 0;
+    }
+
+    // CPU绑定方案，工作线程启动时按其所在的NUMA节点分组绑定
+    cpu_affinity *affinity = cpu_affinity::get_instance();
+    affinity->init(m_affinity, m_loop_cpus.c_str(), m_worker_cpus.c_str(),
+                   m_close_log);
+    affinity->log_plan(m_loop_num + 1,
+                       m_max_threads > m_thread_num ? m_max_threads
+                                                    : m_thread_num);
+
+    // 数据库通道，线程数固定，等待连接的线程不会多于连接数太多
+    m_db_pool = new threadpool<http_conn>(
+        m_actormodel, m_connPool, m_db_threads > 0 ? m_db_threads : m_sql_num,
+        10000, 0, 0, m_close_log);
+
+    // 静态通道，线程不取数据库连接，线程数在[m_min_threads, m_max_threads]之间随负载调整
+    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num,
+                                       10000, m_min_threads, m_max_threads,
+                                       m_close_log);
+    m_pool->set_db_lane(m_db_pool);
+}
+
+void WebServer::static_cache() {
+    // 文件变化由主循环读取inotify事件使缓存失效
+    file_cache *cache = file_cache::get_instance();
+    cache->init(m_root, (long)m_cache_size * 1024 * 1024,
+                (long)m_cache_object * 1024, m_gzip_min, m_close_log);
+    m_cachefd = cache->get_fd();
+
+    // 超过缓存对象上限的大文件只缓存fd和stat结果
+    open_file_cache::get_instance()->init(m_fd_cache, m_fd_cache_valid,
+                                          m_close_log);
+}
+
+void WebServer::routes() {
+    // 路由表在工作线程启动处理请求前建好，之后只读
+    http_conn::register_routes(*router::get_instance());
 }
 
 void WebServer::eventListen() {
     // 网络编程基础步骤
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    m_listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     assert(m_listenfd >= 0);
 
     // 优雅关闭连接
@@ -113,253 +222,755 @@ void WebServer::eventListen() {
     setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
     ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);
-    ret = listen(m_listenfd, 5);
+    // 连接收到数据后才交给accept，只连接不发请求的客户端不占用事件循环
+    int defer = m_header_timeout / 1000 > 0 ? m_header_timeout / 1000 : 1;
+    setsockopt(m_listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer,
+               sizeof(defer));
+    ret = listen(m_listenfd, m_backlog);
     assert(ret >= 0);
 
-    utils.init(TIMESLOT);
+    m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    Utils &utils = m_main_loop->utils;
+    ret = utils.init();
+    assert(ret);
 
     // epoll创建内核事件表
-    epoll_event events[MAX_EVENT_NUMBER];
     m_epollfd = epoll_create(5);
     assert(m_epollfd != -1);
+    m_main_loop->epollfd = m_epollfd;
 
     utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
-    http_conn::m_epollfd = m_epollfd;
+    utils.addfd(m_epollfd, utils.m_timerfd, false, 0);
 
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
-    assert(ret != -1);
-    utils.setnonblocking(m_pipefd[1]);
-    utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+    // SIGTERM、SIGUSR1已在init中屏蔽，这里通过signalfd读取
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    m_signalfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    assert(m_signalfd != -1);
+    utils.addfd(m_epollfd, m_signalfd, false, 0);
 
     utils.addsig(SIGPIPE, SIG_IGN);
-    utils.addsig(SIGALRM, utils.sig_handler, false);
-    utils.addsig(SIGTERM, utils.sig_handler, false);
 
-    alarm(TIMESLOT);
+    if (m_cachefd != -1)
+        utils.addfd(m_epollfd, m_cachefd, false, 0);
+
+    // 工作线程回报处理结果的队列
+    m_main_loop->cq = new completion_queue;
+    assert(m_main_loop->cq->get_fd() != -1);
+    utils.addfd(m_epollfd, m_main_loop->cq->get_fd(), false, 0);
+
+    // sub reactor，各自独立的epoll和定时器
+    for (int i = 0; i < m_loop_num; ++i) {
+        event_loop *loop = new event_loop;
+        loop->id = i + 1;
+        ret = loop->utils.init();
+        assert(ret);
+        loop->epollfd = epoll_create(5);
+        assert(loop->epollfd != -1);
+        loop->utils.addfd(loop->epollfd, loop->utils.m_timerfd, false, 0);
+        loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        assert(loop->wakefd != -1);
+        loop->utils.addfd(loop->epollfd, loop->wakefd, false, 0);
+        loop->cq = new completion_queue;
+        assert(loop->cq->get_fd() != -1);
+        loop->utils.addfd(loop->epollfd, loop->cq->get_fd(), false, 0);
+        m_sub_loops.push_back(loop);
+    }
+
+    if (1 == m_uring_mode && !init_uring()) {
+        LOG_WARN("%s", "io_uring not supported by kernel, fall back to epoll");
+        m_uring_mode = 0;
+    }
 
-    // 工具类,信号和描述符基础操作
-    Utils::u_pipefd = m_pipefd;
-    Utils::u_epollfd = m_epollfd;
+    for (size_t i = 0; i < m_sub_loops.size(); ++i) {
+        m_sub_loops[i]->thread =
+            std::thread(&WebServer::sub_loop, this, m_sub_loops[i]);
+    }
+}
+
+// 为每个事件循环建立独立的ring，任一失败则全部释放
+bool WebServer::init_uring() {
+    std::vector<event_loop *> loops(1, m_main_loop);
+    loops.insert(loops.end(), m_sub_loops.begin(), m_sub_loops.end());
+
+    bool ok = true;
+    for (size_t i = 0; i < loops.size() && ok; ++i) {
+        loops[i]->ring = new uring;
+        ok = loops[i]->ring->init(URING_ENTRIES, URING_BUF_COUNT,
+                                  http_conn::READ_BUFFER_SIZE);
+    }
+    if (!ok) {
+        for (size_t i = 0; i < loops.size(); ++i) {
+            delete loops[i]->ring;
+            loops[i]->ring = NULL;
+        }
+    }
+    return ok;
 }
 
-void WebServer::timer(int connfd, struct sockaddr_in client_address) {
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode,
-                       m_close_log, m_user, m_passWord, m_databaseName);
+void WebServer::timer(event_loop *loop, int connfd,
+                      struct sockaddr_in client_address) {
+    conn_slot *slot = m_conns->acquire(connfd);
+    if (!slot) {
+        loop->utils.show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+
+    int epollfd = loop->ring ? -1 : loop->epollfd;
+    slot->conn.init(connfd, slot->data.io_gen, client_address, epollfd,
+                    loop->cq, m_root, m_CONNTrigmode, m_close_log, m_user,
+                    m_passWord, m_databaseName, m_max_body);
 
     // 初始化client_data数据
-    // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
-    users_timer[connfd].address = client_address;
-    users_timer[connfd].sockfd = connfd;
+    // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到时间轮中
+    client_data *data = &slot->data;
+    data->address = client_address;
+    data->sockfd = connfd;
+    data->epollfd = loop->epollfd;
+    data->conns = m_conns;
+    // 新连接须在请求头超时内发来完整的请求头
     util_timer *timer = new util_timer;
-    timer->user_data = &users_timer[connfd];
+    timer->user_data = data;
     timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    users_timer[connfd].timer = timer;
-    utils.m_timer_lst.add_timer(timer);
+    timer->expire = monotonic_ms() + m_header_timeout;
+    data->timer = timer;
+    loop->utils.m_timer_lst.add_timer(timer);
+
+    // io_uring模式下立即提交第一个recv，提交队列无法腾出位置时关闭连接
+    if (loop->ring &&
+        !loop->ring->prep_recv(connfd,
+                               uring_data(URING_RECV, data->io_gen, connfd))) {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        deal_timer(loop, timer, connfd);
+    }
 }
 
-// 若有数据传输，则将定时器往后延迟3个单位
-// 并对新的定时器在链表上的位置进行调整
-void WebServer::adjust_timer(util_timer *timer) {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    utils.m_timer_lst.adjust_timer(timer);
+// 若有数据传输，则将定时器往后延迟timeout毫秒
+// 并对新的定时器在时间轮上的位置进行调整
+void WebServer::adjust_timer(event_loop *loop, util_timer *timer,
+                             int timeout) {
+    timer->expire = monotonic_ms() + timeout;
+    loop->utils.m_timer_lst.adjust_timer(timer);
+}
+
+// 收到数据时按请求所处阶段调整定时器，需在数据交给工作线程之前判断：
+// 新请求的第一批数据开始计算请求头超时，请求头阶段不再顺延，
+// 读请求体时按空闲超时顺延
+void WebServer::read_timer(event_loop *loop, util_timer *timer, bool idle,
+                           bool in_header) {
+    if (idle) {
+        adjust_timer(loop, timer, m_header_timeout);
+    } else if (!in_header) {
+        adjust_timer(loop, timer, m_idle_timeout);
+    }
+}
 
-    LOG_INFO("%s", "adjust timer once");
+// 发送数据后调整定时器，响应已发完的keep-alive连接按keep-alive超时等待下一个请求
+void WebServer::write_timer(event_loop *loop, util_timer *timer,
+                            http_conn *conn) {
+    if (conn->is_idle()) {
+        adjust_timer(loop, timer, m_keepalive_timeout);
+    } else {
+        adjust_timer(loop, timer, m_idle_timeout);
+    }
 }
 
-void WebServer::deal_timer(util_timer *timer, int sockfd) {
-    timer->cb_func(&users_timer[sockfd]);
-    if (timer) {
-        utils.m_timer_lst.del_timer(timer);
+void WebServer::deal_timer(event_loop *loop, util_timer *timer, int sockfd) {
+    if (!timer) {
+        return;
     }
+    // cb_func会归还连接槽，之后不能再访问该连接
+    timer->cb_func(timer->user_data);
+    loop->utils.m_timer_lst.del_timer(timer);
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+    LOG_INFO("close fd %d", sockfd);
+}
+
+// 线程池队列已满，连接的请求无法处理：处于响应边界时尽力回复503，然后关闭连接
+void WebServer::reject_conn(event_loop *loop, util_timer *timer, int sockfd,
+                            bool reply) {
+    LOG_WARN("thread pool full, close fd %d", sockfd);
+    if (reply) {
+        static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                   "Content-Length:0\r\n"
+                                   "Connection:close\r\n\r\n";
+        send(sockfd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    deal_timer(loop, timer, sockfd);
 }
 
+// 每次最多接受ACCEPT_BATCH个连接，连接突发时其他事件不会长时间得不到处理
+// 没有接受完时置m_accept_pending，由事件循环下一轮继续
 bool WebServer::dealclientdata() {
-    struct sockaddr_in client_address;
-    socklen_t client_addrlength = sizeof(client_address);
-    if (0 == m_LISTENTrigmode) {
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address,
-                            &client_addrlength);
+    m_accept_pending = false;
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        struct sockaddr_in client_address;
+        socklen_t client_addrlength = sizeof(client_address);
+        int connfd = accept4(m_listenfd, (struct sockaddr *)&client_address,
+                             &client_addrlength, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (connfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
             LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            // fd耗尽时accept不看队列直接失败，只有确实丢弃了连接才继续
+            if (errno == EMFILE || errno == ENFILE) {
+                m_accept_pending = shed_conn();
+            }
             return false;
         }
         if (http_conn::m_user_count >= MAX_FD) {
-            utils.show_error(connfd, "Internal server busy");
+            m_main_loop->utils.show_error(connfd, "Internal server busy");
             LOG_ERROR("%s", "Internal server busy");
-            return false;
+            continue;
         }
-        timer(connfd, client_address);
+        dispatch_conn(connfd, client_address);
     }
+    m_accept_pending = true;
+    return true;
+}
 
-    else {
-        while (1) {
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address,
-                                &client_addrlength);
-            if (connfd < 0) {
-                LOG_ERROR("%s:errno is:%d", "accept error", errno);
-                break;
-            }
-            if (http_conn::m_user_count >= MAX_FD) {
-                utils.show_error(connfd, "Internal server busy");
-                LOG_ERROR("%s", "Internal server busy");
-                break;
-            }
-            timer(connfd, client_address);
-        }
-        return false;
+// fd耗尽时连接一直留在全连接队列中，监听fd持续可读，事件循环会空转
+// 释放预留的fd接受一个连接并立即关闭，再重新预留；队列已空时返回false
+bool WebServer::shed_conn() {
+    if (m_idlefd != -1)
+        close(m_idlefd);
+    int connfd = accept4(m_listenfd, NULL, NULL, SOCK_CLOEXEC);
+    if (connfd >= 0)
+        close(connfd);
+    m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return connfd >= 0;
+}
+
+// 单reactor直接接管新连接，多reactor时轮询投递给sub reactor
+void WebServer::dispatch_conn(int connfd, struct sockaddr_in client_address) {
+    if (m_sub_loops.empty()) {
+        timer(m_main_loop, connfd, client_address);
+        return;
     }
-    return true;
+
+    event_loop *loop = m_sub_loops[m_next_loop++ % m_sub_loops.size()];
+    {
+        std::unique_lock<std::mutex> lock(loop->lock);
+        loop->pending.push_back(std::make_pair(connfd, client_address));
+    }
+    uint64_t one = 1;
+    ::write(loop->wakefd, &one, sizeof(one));
 }
 
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server) {
-    int ret = 0;
-    int sig;
-    char signals[1024];
-    ret = recv(m_pipefd[0], signals, sizeof(signals), 0);
-    if (ret == -1) {
-        return false;
-    } else if (ret == 0) {
-        return false;
-    } else {
-        for (int i = 0; i < ret; ++i) {
-            switch (signals[i]) {
-            case SIGALRM: {
-                timeout = true;
-                break;
-            }
-            case SIGTERM: {
-                stop_server = true;
-                break;
-            }
-            }
+bool WebServer::dealwithsignal(bool &stop_server) {
+    struct signalfd_siginfo info;
+    bool ret = false;
+    while (read(m_signalfd, &info, sizeof(info)) == sizeof(info)) {
+        ret = true;
+        switch (info.ssi_signo) {
+        case SIGTERM: {
+            stop_server = true;
+            break;
+        }
+        // 输出静态文件缓存的命中统计和线程池的自适应统计
+        case SIGUSR1: {
+            file_cache::get_instance()->log_stats();
+            open_file_cache::get_instance()->log_stats();
+            m_pool->log_stats("static lane");
+            m_db_pool->log_stats("db lane");
+            break;
+        }
         }
     }
-    return true;
+    return ret;
 }
 
-void WebServer::dealwithread(int sockfd) {
-    util_timer *timer = users_timer[sockfd].timer;
+// sub reactor被唤醒：接管新连接，处理定时和退出通知
+void WebServer::dealwithwakeup(event_loop *loop) {
+    uint64_t cnt;
+    while (read(loop->wakefd, &cnt, sizeof(cnt)) > 0) {
+    }
+
+    std::vector<std::pair<int, sockaddr_in>> conns;
+    {
+        std::unique_lock<std::mutex> lock(loop->lock);
+        conns.swap(loop->pending);
+    }
+    for (size_t i = 0; i < conns.size(); ++i) {
+        timer(loop, conns[i].first, conns[i].second);
+    }
+}
+
+void WebServer::dealwithread(event_loop *loop, int sockfd) {
+    conn_slot *slot = m_conns->get(sockfd);
+    // 定时器为空的连接正在等待工作线程处理完毕后关闭，不再处理新的数据
+    if (!slot || !slot->data.timer) {
+        return;
+    }
+    http_conn *conn = &slot->conn;
+    util_timer *timer = slot->data.timer;
+    bool idle = conn->is_idle();
+    bool in_header = conn->in_header();
 
     // reactor
     if (1 == m_actormodel) {
-        if (timer) {
-            adjust_timer(timer);
-        }
+        read_timer(loop, timer, idle, in_header);
 
         // 若监测到读事件，将该事件放入请求队列
-        m_pool->append(users + sockfd, 0);
-
-        while (true) {
-            if (1 == users[sockfd].improv) {
-                if (1 == users[sockfd].timer_flag) {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        // 处理结果由工作线程经completion_queue异步回报
+        if (!m_pool->append(conn, 0))
+            reject_conn(loop, timer, sockfd, true);
     } else {
         // proactor
-        if (users[sockfd].read_once()) {
+        if (conn->read_once()) {
             LOG_INFO("deal with the client(%s)",
-                     inet_ntoa(users[sockfd].get_address()->sin_addr));
+                     inet_ntoa(conn->get_address()->sin_addr));
 
-            // 若监测到读事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);
+            read_timer(loop, timer, idle, in_header);
 
-            if (timer) {
-                adjust_timer(timer);
-            }
+            // 若监测到读事件，将该事件放入请求队列
+            if (!m_pool->append_p(conn))
+                reject_conn(loop, timer, sockfd, true);
         } else {
-            deal_timer(timer, sockfd);
+            deal_timer(loop, timer, sockfd);
         }
     }
 }
 
-void WebServer::dealwithwrite(int sockfd) {
-    util_timer *timer = users_timer[sockfd].timer;
+void WebServer::dealwithwrite(event_loop *loop, int sockfd) {
+    conn_slot *slot = m_conns->get(sockfd);
+    if (!slot || !slot->data.timer) {
+        return;
+    }
+    http_conn *conn = &slot->conn;
+    util_timer *timer = slot->data.timer;
     // reactor
     if (1 == m_actormodel) {
-        if (timer) {
-            adjust_timer(timer);
-        }
-
-        m_pool->append(users + sockfd, 1);
+        adjust_timer(loop, timer, m_idle_timeout);
 
-        while (true) {
-            if (1 == users[sockfd].improv) {
-                if (1 == users[sockfd].timer_flag) {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        // 响应可能只发送了一部分，不能再插入503
+        if (!m_pool->append(conn, 1))
+            reject_conn(loop, timer, sockfd, false);
     } else {
         // proactor
-        if (users[sockfd].write()) {
+        bool more;
+        if (conn->write(more)) {
             LOG_INFO("send data to the client(%s)",
-                     inet_ntoa(users[sockfd].get_address()->sin_addr));
+                     inet_ntoa(conn->get_address()->sin_addr));
 
-            if (timer) {
-                adjust_timer(timer);
-            }
+            write_timer(loop, timer, conn);
+
+            // 流水线中的后续请求已在读缓冲区，直接交给工作线程
+            if (more && !m_pool->append_p(conn))
+                reject_conn(loop, timer, sockfd, true);
         } else {
-            deal_timer(timer, sockfd);
+            deal_timer(loop, timer, sockfd);
         }
     }
 }
 
 void WebServer::eventLoop() {
-    bool timeout = false;
+    cpu_affinity::get_instance()->bind_loop(0);
+    run_loop(m_main_loop);
+    stop_sub_loops();
+}
+
+void WebServer::run_loop(event_loop *loop) {
+    if (loop->ring) {
+        run_uring_loop(loop);
+        return;
+    }
+
     bool stop_server = false;
 
     while (!stop_server) {
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        bool pending = loop == m_main_loop && m_accept_pending;
+        int number = epoll_wait(loop->epollfd, loop->events, MAX_EVENT_NUMBER,
+                                pending ? 0 : -1);
         if (number < 0 && errno != EINTR) {
             LOG_ERROR("%s", "epoll failure");
             break;
         }
 
         for (int i = 0; i < number; i++) {
-            int sockfd = events[i].data.fd;
+            int sockfd = loop->events[i].data.fd;
 
             // 处理新到的客户连接
-            if (sockfd == m_listenfd) {
+            if (loop == m_main_loop && sockfd == m_listenfd) {
+                pending = false;
                 bool flag = dealclientdata();
                 if (false == flag)
                     continue;
-            } else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            }
+            // 主reactor投递的新连接及通知
+            else if (sockfd == loop->wakefd) {
+                dealwithwakeup(loop);
+            }
+            // 工作线程回报的处理结果
+            else if (sockfd == loop->cq->get_fd()) {
+                dealwithcompletion(loop);
+            } else if (loop->events[i].events &
+                       (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 // 服务器端关闭连接，移除对应的定时器
-                util_timer *timer = users_timer[sockfd].timer;
-                deal_timer(timer, sockfd);
+                conn_slot *slot = m_conns->get(sockfd);
+                if (slot) {
+                    deal_timer(loop, slot->data.timer, sockfd);
+                }
             }
             // 处理信号
-            else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN)) {
-                bool flag = dealwithsignal(timeout, stop_server);
+            else if (loop == m_main_loop && (sockfd == m_signalfd) &&
+                     (loop->events[i].events & EPOLLIN)) {
+                bool flag = dealwithsignal(stop_server);
                 if (false == flag)
-                    LOG_ERROR("%s", "dealclientdata failure");
+                    LOG_ERROR("%s", "dealwithsignal failure");
+            }
+            // 静态文件有变化，使对应的缓存失效
+            else if (loop == m_main_loop && sockfd == m_cachefd) {
+                file_cache::get_instance()->handle_events();
+            }
+            // 定时器到期
+            else if (sockfd == loop->utils.m_timerfd) {
+                loop->utils.timer_handler();
             }
             // 处理客户连接上接收到的数据
-            else if (events[i].events & EPOLLIN) {
-                dealwithread(sockfd);
-            } else if (events[i].events & EPOLLOUT) {
-                dealwithwrite(sockfd);
+            else if (loop->events[i].events & EPOLLIN) {
+                dealwithread(loop, sockfd);
+            } else if (loop->events[i].events & EPOLLOUT) {
+                dealwithwrite(loop, sockfd);
             }
         }
-        if (timeout) {
-            utils.timer_handler();
 
-            LOG_INFO("%s", "timer tick");
+        // ET模式下上一批没有接受完的连接不会再次通知
+        if (pending) {
+            dealclientdata();
+        }
+
+        // sub reactor的退出由主reactor通知
+        if (loop->stop) {
+            stop_server = true;
+        }
+
+        // 本轮新增的定时器可能早于timerfd当前的到期时间
+        loop->utils.rearm_timer();
+    }
+}
+
+// io_uring事件循环
+// 所有recv/sendmsg请求在每轮循环中一次io_uring_enter批量提交，
+// 同时等待完成事件，keep-alive请求不再需要额外的epoll_ctl和读写系统调用
+void WebServer::run_uring_loop(event_loop *loop) {
+    bool stop_server = false;
+    uring *ring = loop->ring;
+
+    if (loop == m_main_loop) {
+        ring->prep_accept_multishot(m_listenfd,
+                                    uring_data(URING_ACCEPT, 0, m_listenfd));
+        ring->prep_poll_multishot(m_signalfd,
+                                  uring_data(URING_POLL, 0, m_signalfd));
+        if (m_cachefd != -1)
+            ring->prep_poll_multishot(m_cachefd,
+                                      uring_data(URING_POLL, 0, m_cachefd));
+    } else {
+        ring->prep_poll_multishot(loop->wakefd,
+                                  uring_data(URING_POLL, 0, loop->wakefd));
+    }
+    ring->prep_poll_multishot(loop->cq->get_fd(),
+                              uring_data(URING_POLL, 0, loop->cq->get_fd()));
+    ring->prep_poll_multishot(
+        loop->utils.m_timerfd,
+        uring_data(URING_POLL, 0, loop->utils.m_timerfd));
+
+    while (!stop_server) {
+        int ret = ring->submit_and_wait(1);
+        if (ret < 0 && errno != EINTR) {
+            LOG_ERROR("%s", "io_uring_enter failure");
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = ring->peek_cqe()) != NULL) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            unsigned int flags = cqe->flags;
+            ring->cqe_seen();
+
+            int op = (int)(data >> 56);
+            unsigned int gen = (unsigned int)(data >> 32) & 0xffffff;
+            int fd = (int)(uint32_t)data;
+            switch (op) {
+            case URING_ACCEPT: {
+                bool rearm = true;
+                if (res >= 0) {
+                    dealwithaccept(res);
+                } else {
+                    LOG_ERROR("%s:errno is:%d", "accept error", -res);
+                    // fd耗尽且队列已空时立即重新提交会一直失败，等有新连接再恢复
+                    if (res == -EMFILE || res == -ENFILE)
+                        rearm = shed_conn();
+                }
+                // 多发accept被内核终止时重新提交
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    bool ok;
+                    if (rearm)
+                        ok = ring->prep_accept_multishot(
+                            m_listenfd,
+                            uring_data(URING_ACCEPT, 0, m_listenfd));
+                    else
+                        ok = ring->prep_poll(
+                            m_listenfd,
+                            uring_data(URING_LISTEN, 0, m_listenfd));
+                    if (!ok)
+                        LOG_ERROR("%s", "io_uring submission queue full");
+                }
+                break;
+            }
+            case URING_LISTEN: {
+                if (!ring->prep_accept_multishot(
+                        m_listenfd, uring_data(URING_ACCEPT, 0, m_listenfd)))
+                    LOG_ERROR("%s", "io_uring submission queue full");
+                break;
+            }
+            case URING_POLL: {
+                if (loop == m_main_loop && fd == m_signalfd) {
+                    bool flag = dealwithsignal(stop_server);
+                    if (false == flag)
+                        LOG_ERROR("%s", "dealwithsignal failure");
+                } else if (loop == m_main_loop && fd == m_cachefd) {
+                    file_cache::get_instance()->handle_events();
+                } else if (fd == loop->utils.m_timerfd) {
+                    loop->utils.timer_handler();
+                } else if (fd == loop->wakefd) {
+                    dealwithwakeup(loop);
+                } else {
+                    dealwithcompletion(loop);
+                }
+                if (!(flags & IORING_CQE_F_MORE) &&
+                    !ring->prep_poll_multishot(fd,
+                                               uring_data(URING_POLL, 0, fd))) {
+                    LOG_ERROR("%s", "io_uring submission queue full");
+                }
+                break;
+            }
+            case URING_RECV: {
+                dealwithrecv(loop, fd, gen, res, flags);
+                break;
+            }
+            case URING_WRITE: {
+                dealwithsent(loop, fd, gen, res);
+                break;
+            }
+            case URING_SENDFILE: {
+                dealwithsendfile(loop, fd, gen);
+                break;
+            }
+            }
+        }
+
+        if (loop->stop) {
+            stop_server = true;
+        }
+
+        loop->utils.rearm_timer();
+    }
+}
+
+// 多发accept得到的新连接
+void WebServer::dealwithaccept(int connfd) {
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+    if (http_conn::m_user_count >= MAX_FD) {
+        m_main_loop->utils.show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+    bzero(&client_address, sizeof(client_address));
+    getpeername(connfd, (struct sockaddr *)&client_address,
+                &client_addrlength);
+    dispatch_conn(connfd, client_address);
+}
+
+// 工作线程回报的处理结果，事件为0表示需要关闭连接
+// io_uring模式下还需按其要求提交下一个recv或sendmsg
+// 代数与连接槽不一致的是回报给已关闭连接的，其fd已被新连接复用，丢弃
+// 定时器为空的连接在工作线程处理期间被要求关闭过，最后一个任务结束时回报关闭
+void WebServer::dealwithcompletion(event_loop *loop) {
+    std::vector<completion> items;
+    loop->cq->drain(items);
+    for (size_t i = 0; i < items.size(); ++i) {
+        int sockfd = items[i].sockfd;
+        conn_slot *slot = m_conns->get(sockfd);
+        if (!slot || slot->data.io_gen != items[i].gen) {
+            continue;
+        }
+        http_conn *conn = &slot->conn;
+        if (0 == items[i].ev) {
+            conn->timer_flag = 0;
+            if (slot->data.timer)
+                deal_timer(loop, slot->data.timer, sockfd);
+            else
+                cb_func(&slot->data);
+            continue;
+        }
+        if (!slot->data.timer || !loop->ring) {
+            continue;
+        }
+        uint64_t gen = slot->data.io_gen;
+        bool ok = true;
+        if (items[i].ev == EPOLLIN) {
+            ok = loop->ring->prep_recv(sockfd,
+                                       uring_data(URING_RECV, gen, sockfd));
+        } else if (items[i].ev == EPOLLOUT) {
+            ok = uring_send(loop, conn, sockfd, gen);
+        }
+        if (!ok) {
+            LOG_ERROR("%s", "io_uring submission queue full");
+            deal_timer(loop, slot->data.timer, sockfd);
+        }
+    }
+}
+
+void WebServer::dealwithrecv(event_loop *loop, int sockfd, unsigned int gen,
+                             int res, unsigned int flags) {
+    uring *ring = loop->ring;
+    bool has_buf = flags & IORING_CQE_F_BUFFER;
+    unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    conn_slot *slot = m_conns->get(sockfd);
+
+    // 连接已关闭，丢弃过期的完成事件
+    if (!slot || !slot->data.timer ||
+        gen != (slot->data.io_gen & 0xffffff)) {
+        if (has_buf)
+            ring->recycle_buf(bid);
+        return;
+    }
 
-            timeout = false;
+    http_conn *conn = &slot->conn;
+    util_timer *timer = slot->data.timer;
+    // provided buffer暂时用尽，稍后重试
+    if (res == -ENOBUFS) {
+        if (!ring->prep_recv(sockfd, uring_data(URING_RECV, gen, sockfd))) {
+            LOG_ERROR("%s", "io_uring submission queue full");
+            deal_timer(loop, timer, sockfd);
         }
+        return;
+    }
+    if (res <= 0 || !has_buf) {
+        deal_timer(loop, timer, sockfd);
+        return;
+    }
+
+    bool idle = conn->is_idle();
+    bool in_header = conn->in_header();
+    bool ok = conn->append_read(ring->buf_addr(bid), res);
+    ring->recycle_buf(bid);
+    if (!ok) {
+        deal_timer(loop, timer, sockfd);
+        return;
+    }
+
+    LOG_INFO("deal with the client(%s)",
+             inet_ntoa(conn->get_address()->sin_addr));
+
+    read_timer(loop, timer, idle, in_header);
+
+    // 若监测到读事件，将该事件放入请求队列
+    if (!m_pool->append_p(conn))
+        reject_conn(loop, timer, sockfd, true);
+}
+
+void WebServer::dealwithsent(event_loop *loop, int sockfd, unsigned int gen,
+                             int res) {
+    conn_slot *slot = m_conns->get(sockfd);
+    if (!slot || !slot->data.timer ||
+        gen != (slot->data.io_gen & 0xffffff)) {
+        return;
+    }
+    http_conn *conn = &slot->conn;
+    util_timer *timer = slot->data.timer;
+
+    if (res == -EAGAIN) {
+        if (!uring_send(loop, conn, sockfd, gen)) {
+            LOG_ERROR("%s", "io_uring submission queue full");
+            deal_timer(loop, timer, sockfd);
+        }
+        return;
+    }
+
+    bool pending = false;
+    if (res < 0 || !conn->complete_write(res, pending)) {
+        deal_timer(loop, timer, sockfd);
+        return;
+    }
+
+    if (pending) {
+        if (!uring_send(loop, conn, sockfd, gen)) {
+            LOG_ERROR("%s", "io_uring submission queue full");
+            deal_timer(loop, timer, sockfd);
+            return;
+        }
+        adjust_timer(loop, timer, m_idle_timeout);
+        return;
+    }
+
+    LOG_INFO("send data to the client(%s)",
+             inet_ntoa(conn->get_address()->sin_addr));
+
+    // keep-alive连接继续接收下一个请求，流水线中的后续请求已在读缓冲区时直接处理
+    write_timer(loop, timer, conn);
+    if (conn->has_buffered_request()) {
+        if (!m_pool->append_p(conn)) {
+            reject_conn(loop, timer, sockfd, true);
+            return;
+        }
+    } else if (!loop->ring->prep_recv(sockfd,
+                                      uring_data(URING_RECV, gen, sockfd))) {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        deal_timer(loop, timer, sockfd);
+    }
+}
+
+// 提交下一段数据的发送：响应头用sendmsg，io_uring没有sendfile操作，
+// 文件段先poll等待可写，再由事件循环用非阻塞的sendfile发送一块
+// 提交队列无法腾出位置时返回false，由调用方关闭连接
+bool WebServer::uring_send(event_loop *loop, http_conn *conn, int sockfd,
+                           uint64_t gen) {
+    int flags = 0;
+    struct msghdr *msg = conn->get_msg(flags);
+    if (msg)
+        return loop->ring->prep_sendmsg(sockfd, msg, flags,
+                                        uring_data(URING_WRITE, gen, sockfd));
+    return loop->ring->prep_poll(
+        sockfd, uring_data(URING_SENDFILE, gen, sockfd), POLLOUT);
+}
+
+// 连接可写，发送文件的下一块，结果和sendmsg完成事件一样处理
+void WebServer::dealwithsendfile(event_loop *loop, int sockfd,
+                                 unsigned int gen) {
+    conn_slot *slot = m_conns->get(sockfd);
+    if (!slot || !slot->data.timer ||
+        gen != (slot->data.io_gen & 0xffffff)) {
+        return;
+    }
+    int res = slot->conn.send_file();
+    dealwithsent(loop, sockfd, gen, res < 0 ? -errno : res);
+}
+
+// sub reactor线程，SIGTERM在init中已屏蔽，统一由主reactor的signalfd处理
+// 先绑定CPU，之后接管的连接槽和缓冲区都从本节点分配
+void WebServer::sub_loop(event_loop *loop) {
+    cpu_affinity::get_instance()->bind_loop(loop->id);
+    run_loop(loop);
+}
+
+void WebServer::stop_sub_loops() {
+    for (size_t i = 0; i < m_sub_loops.size(); ++i) {
+        event_loop *loop = m_sub_loops[i];
+        if (!loop->thread.joinable())
+            continue;
+        loop->stop = true;
+        uint64_t one = 1;
+        ::write(loop->wakefd, &one, sizeof(one));
+        loop->thread.join();
     }
 }
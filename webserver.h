@@ -6,18 +6,59 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "./http/conn_table.h"
 #include "./http/http_conn.h"
+#include "./io/completion_queue.h"
+#include "./io/uring.h"
 #include "./threadpool/threadpool.h"
 
 const int MAX_FD = 65536;           // 最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; // 最大事件数
-const int TIMESLOT = 5;             // 最小超时单位
+const int URING_ENTRIES = 4096;     // io_uring提交队列长度
+const int URING_BUF_COUNT = 1024;   // 每个事件循环的provided buffer数量
+const int ACCEPT_BATCH = 64;        // 每轮事件循环最多接受的连接数
+
+// 单个reactor的事件循环状态
+// 单reactor模式下只有主循环，监听、信号和连接都在其中；
+// 多reactor模式下主循环只负责accept和信号，连接按轮询分发给各个sub reactor，
+// 每个sub reactor拥有独立的epoll、定时器链表以及分到自己名下的那部分连接
+// 工作线程的处理结果经cq异步回报，io_uring模式下每个循环另有独立的ring
+struct event_loop {
+    event_loop()
+        : id(0), epollfd(-1), wakefd(-1), ring(NULL), cq(NULL), stop(false) {}
+    ~event_loop() {
+        delete ring;
+        delete cq;
+    }
+
+    int id;
+    int epollfd;
+    int wakefd; // eventfd，主reactor投递新连接、退出通知
+    Utils utils;
+    epoll_event events[MAX_EVENT_NUMBER];
+    uring *ring;
+    completion_queue *cq;
+
+    std::mutex lock;                                    // 保护pending
+    std::vector<std::pair<int, sockaddr_in>> pending; // 待接管的新连接
+    std::atomic<bool> stop;
+    std::thread thread;
+};
 
 class WebServer {
   public:
@@ -26,22 +67,53 @@ class WebServer {
 
     void init(int port, std::string user, std::string passWord,
               std::string databaseName, int log_write, int opt_linger,
-              int trigmode, int sql_num, int thread_num, int close_log,
-              int actor_model);
+              int trigmode, int sql_num, int thread_num, int loop_num,
+              int close_log, int actor_model, int uring_mode,
+              int idle_timeout, int header_timeout, int keepalive_timeout,
+              int max_body, int backlog, int cache_size, int cache_object,
+              int fd_cache, int fd_cache_valid, int gzip_min, int affinity,
+              std::string loop_cpus, std::string worker_cpus,
+              int min_threads, int max_threads, int db_threads);
 
     void thread_pool();
+    void static_cache();
+    void routes();
     void sql_pool();
     void log_write();
     void trig_mode();
     void eventListen();
     void eventLoop();
-    void timer(int connfd, struct sockaddr_in client_address);
-    void adjust_timer(util_timer *timer);
-    void deal_timer(util_timer *timer, int sockfd);
+    void timer(event_loop *loop, int connfd,
+               struct sockaddr_in client_address);
+    void adjust_timer(event_loop *loop, util_timer *timer, int timeout);
+    void read_timer(event_loop *loop, util_timer *timer, bool idle,
+                    bool in_header);
+    void write_timer(event_loop *loop, util_timer *timer, http_conn *conn);
+    void deal_timer(event_loop *loop, util_timer *timer, int sockfd);
+    void reject_conn(event_loop *loop, util_timer *timer, int sockfd,
+                     bool reply);
     bool dealclientdata();
-    bool dealwithsignal(bool &timeout, bool &stop_server);
-    void dealwithread(int sockfd);
-    void dealwithwrite(int sockfd);
+    void dispatch_conn(int connfd, struct sockaddr_in client_address);
+    bool dealwithsignal(bool &stop_server);
+    void dealwithwakeup(event_loop *loop);
+    void dealwithread(event_loop *loop, int sockfd);
+    void dealwithwrite(event_loop *loop, int sockfd);
+
+  private:
+    void run_loop(event_loop *loop);
+    void run_uring_loop(event_loop *loop);
+    bool init_uring();
+    void dealwithaccept(int connfd);
+    bool shed_conn();
+    void dealwithcompletion(event_loop *loop);
+    void dealwithrecv(event_loop *loop, int sockfd, unsigned int gen, int res,
+                      unsigned int flags);
+    void dealwithsent(event_loop *loop, int sockfd, unsigned int gen, int res);
+    bool uring_send(event_loop *loop, http_conn *conn, int sockfd,
+                    uint64_t gen);
+    void dealwithsendfile(event_loop *loop, int sockfd, unsigned int gen);
+    void sub_loop(event_loop *loop);
+    void stop_sub_loops();
 
   public:
     // 基础
@@ -50,10 +122,21 @@ class WebServer {
     int m_log_write;
     int m_close_log;
     int m_actormodel;
+    int m_uring_mode; // 1使用io_uring，内核不支持时回退到epoll
+    int m_max_body;   // 请求体长度上限，字节
+    int m_cache_size;   // 静态文件缓存大小，MB，0表示关闭
+    int m_cache_object; // 可缓存的最大文件，KB
+    int m_fd_cache;       // 缓存的打开文件数，0表示关闭
+    int m_fd_cache_valid; // 打开文件缓存的重新验证间隔，毫秒
+    int m_gzip_min;       // 启用gzip的最小文件，字节，0表示关闭
+    int m_affinity;            // 1按NUMA节点绑定事件循环和工作线程
+    std::string m_loop_cpus;   // 事件循环可用的CPU列表，空表示全部
+    std::string m_worker_cpus; // 工作线程可用的CPU列表，空表示全部
 
-    int m_pipefd[2];
+    int m_signalfd;
+    int m_cachefd; // 静态文件缓存的inotify fd，-1表示未启用
     int m_epollfd;
-    http_conn *users;
+    conn_table *m_conns; // 按fd索引的稀疏连接表
 
     // 数据库相关
     connection_pool *m_connPool;
@@ -65,18 +148,29 @@ class WebServer {
     // 线程池相关
     threadpool<http_conn> *m_pool;
     int m_thread_num;
+    int m_min_threads; // 自适应的线程数范围，0表示取m_thread_num
+    int m_max_threads;
+    threadpool<http_conn> *m_db_pool; // 数据库通道，执行需要数据库连接的路由
+    int m_db_threads;                 // 数据库通道的线程数，0表示取m_sql_num
 
-    // epoll_event相关
-    epoll_event events[MAX_EVENT_NUMBER];
+    // reactor相关
+    int m_loop_num; // sub reactor数量，0表示单reactor
+    event_loop *m_main_loop;
+    std::vector<event_loop *> m_sub_loops;
+    unsigned int m_next_loop; // 轮询分发下标
 
     int m_listenfd;
+    int m_backlog;        // 全连接队列长度
+    int m_idlefd;         // 预留的fd，fd耗尽时借它接受并关闭一个连接
+    bool m_accept_pending; // 上一批没有接受完，下一轮事件循环不阻塞
     int m_OPT_LINGER;
     int m_TRIGMode;
     int m_LISTENTrigmode;
     int m_CONNTrigmode;
 
-    // 定时器相关
-    client_data *users_timer;
-    Utils utils;
+    // 定时器相关，超时均为毫秒
+    int m_idle_timeout;      // 请求处理中无数据传输
+    int m_header_timeout;    // 从请求开始到请求头接收完毕
+    int m_keepalive_timeout; // keep-alive连接等待下一个请求
 };
 #endif